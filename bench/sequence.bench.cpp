@@ -0,0 +1,655 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <ferrugo/core/sequence.hpp>
+#include <ferrugo/core/sequence_io.hpp>
+#include <ferrugo/core/static_sequence.hpp>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace ferrugo;
+
+namespace
+{
+
+std::atomic<std::size_t> allocation_count{ 0 };
+
+}  // namespace
+
+void* operator new(std::size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size != 0 ? size : 1))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+// The replaced operators allocate with malloc, which GCC does not see once operator delete is inlined into a caller
+// of the library operator new, hence its -Wmismatched-new-delete about the free below.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace
+{
+
+template <class T>
+void do_not_optimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct measurement
+{
+    double ns_per_element;
+    double allocations_per_run;
+};
+
+// Runs func repeatedly and reports the best time per element and the number of allocations per run.
+template <class Func>
+auto measure(std::size_t elements, Func&& func) -> measurement
+{
+    static constexpr int runs = 7;
+    double best = std::numeric_limits<double>::max();
+    const std::size_t allocations_before = allocation_count.load();
+    for (int run = 0; run < runs; ++run)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        do_not_optimize(func());
+        const auto stop = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(stop - start).count());
+    }
+    const std::size_t allocations = allocation_count.load() - allocations_before;
+    return measurement{ best / static_cast<double>(elements), static_cast<double>(allocations) / runs };
+}
+
+struct benchmark_t
+{
+    std::string name;
+    std::size_t elements;
+    std::function<long long()> sequence;
+    std::function<long long()> loop;
+};
+
+void print_header()
+{
+    std::cout << std::left << std::setw(36) << "benchmark" << std::right  //
+              << std::setw(14) << "seq ns/elem" << std::setw(14) << "loop ns/elem" << std::setw(10) << "ratio"
+              << std::setw(14) << "seq allocs" << std::setw(14) << "loop allocs" << '\n';
+}
+
+void run(const benchmark_t& benchmark)
+{
+    const long long expected = benchmark.loop();
+    const long long actual = benchmark.sequence();
+    const measurement seq = measure(benchmark.elements, benchmark.sequence);
+    const measurement loop = measure(benchmark.elements, benchmark.loop);
+
+    std::cout << std::left << std::setw(36) << benchmark.name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(14) << seq.ns_per_element << std::setw(14) << loop.ns_per_element << std::setw(10)
+              << std::setprecision(2) << seq.ns_per_element / loop.ns_per_element << std::setprecision(1)
+              << std::setw(14) << seq.allocations_per_run << std::setw(14) << loop.allocations_per_run;
+    if (actual != expected)
+    {
+        std::cout << "  MISMATCH: " << actual << " != " << expected;
+    }
+    std::cout << '\n';
+}
+
+auto make_csv(std::size_t lines) -> std::string
+{
+    std::string text;
+    for (std::size_t i = 0; i < lines; ++i)
+    {
+        text += std::to_string(i) + ",\"name, " + std::to_string(i % 97) + "\"," + std::to_string(i % 1000) + "\n";
+    }
+    return text;
+}
+
+auto make_text(std::size_t lines) -> std::string
+{
+    std::string text;
+    for (std::size_t i = 0; i < lines; ++i)
+    {
+        text += "line number " + std::to_string(i) + " with some payload\n";
+    }
+    return text;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+    std::vector<int> ints(n);
+    std::iota(ints.begin(), ints.end(), 0);
+    const std::vector<int> other(ints.rbegin(), ints.rend());
+    std::vector<double> doubles(n);
+    std::transform(ints.begin(), ints.end(), doubles.begin(), [](int x) { return x % 1000; });
+    const std::size_t line_count = n / 10;
+    const std::string text = make_text(line_count);
+    const std::string csv = make_csv(line_count);
+    const std::string text_path = (std::filesystem::temp_directory_path() / "ferrugo-core-bench-lines.txt").string();
+    std::ofstream(text_path, std::ios::binary) << text;
+    const std::string records_path = (std::filesystem::temp_directory_path() / "ferrugo-core-bench-records.bin").string();
+    std::ofstream(records_path, std::ios::binary)
+        .write(reinterpret_cast<const char*>(ints.data()), static_cast<std::streamsize>(n * sizeof(int)));
+
+    const auto is_even = [](auto x) { return x % 2 == 0; };
+    const auto square = [](int x) { return static_cast<long long>(x) * x; };
+    const auto plus = [](long long acc, long long x) { return acc + x; };
+    // Depends on the order of the elements.
+    const auto fold_in_order = [](long long acc, long long x) { return (acc * 31 + x) % 1000000007; };
+
+    // Permutations of ints, so that the keys are not inserted and looked up in order.
+    std::vector<int> build_keys(n);
+    std::vector<int> probe_keys(n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        build_keys[i] = static_cast<int>(i * 7919 % n);
+        probe_keys[i] = static_cast<int>(i * 104729 % n);
+    }
+    const std::string join_label = "hash_join(" + std::to_string(n) + " build";
+    const auto identity = [](int x) { return x; };
+    const auto sum_join = [](long long acc, const std::tuple<int, int>& t) { return acc + std::get<0>(t) - std::get<1>(t); };
+    const auto loop_join = [&]
+    {
+        std::unordered_map<int, int> table;
+        table.reserve(n);
+        for (int x : build_keys)
+        {
+            table.emplace(x, x);
+        }
+        long long acc = 0;
+        for (int key : probe_keys)
+        {
+            const auto found = table.find(key);
+            if (found != table.end())
+            {
+                acc += found->second - key;
+            }
+        }
+        return acc;
+    };
+
+    const std::vector<benchmark_t> benchmarks = {
+        { "range.accumulate",
+          n,
+          [&] { return core::range(0, static_cast<int>(n)).accumulate(0LL, plus); },
+          [&]
+          {
+              long long sum = 0;
+              for (int i = 0; i < static_cast<int>(n); ++i)
+              {
+                  sum += i;
+              }
+              return sum;
+          } },
+        { "iota.take.transform.filter",
+          n,
+          [&]
+          {
+              return core::iota(0)
+                  .take(static_cast<std::ptrdiff_t>(n))
+                  .transform(square)
+                  .filter(is_even)
+                  .accumulate(0LL, plus);
+          },
+          [&]
+          {
+              long long sum = 0;
+              for (int i = 0; i < static_cast<int>(n); ++i)
+              {
+                  const long long v = square(i);
+                  sum += is_even(v) ? v : 0;
+              }
+              return sum;
+          } },
+        { "view.filter.transform.drop.take",
+          n,
+          [&]
+          {
+              return core::view(ints)
+                  .filter(is_even)
+                  .transform(square)
+                  .drop(10)
+                  .take(static_cast<std::ptrdiff_t>(n / 4))
+                  .accumulate(0LL, plus);
+          },
+          [&]
+          {
+              long long sum = 0;
+              std::size_t index = 0;
+              for (int x : ints)
+              {
+                  if (!is_even(x))
+                  {
+                      continue;
+                  }
+                  if (index >= 10 && index < 10 + n / 4)
+                  {
+                      sum += square(x);
+                  }
+                  ++index;
+              }
+              return sum;
+          } },
+        { "view.iterator loop",
+          n,
+          [&]
+          {
+              long long sum = 0;
+              for (int x : core::view(ints))
+              {
+                  sum += x;
+              }
+              return sum;
+          },
+          [&] { return std::accumulate(ints.begin(), ints.end(), 0LL); } },
+        { "view -> std::vector",
+          n,
+          [&]
+          {
+              const std::vector<int> result = core::view(ints).transform([](int x) { return x + 1; });
+              return static_cast<long long>(result.size());
+          },
+          [&]
+          {
+              std::vector<int> result;
+              result.reserve(ints.size());
+              for (int x : ints)
+              {
+                  result.push_back(x + 1);
+              }
+              return static_cast<long long>(result.size());
+          } },
+        { "owning.accumulate",
+          n,
+          [&] { return core::owning(ints).accumulate(0LL, plus); },
+          [&]
+          {
+              const std::vector<int> copy = ints;
+              return std::accumulate(copy.begin(), copy.end(), 0LL);
+          } },
+        { "concat.accumulate",
+          2 * n,
+          [&] { return core::concat(core::view(ints), core::view(other)).accumulate(0LL, plus); },
+          [&]
+          {
+              return std::accumulate(ints.begin(), ints.end(), 0LL)  //
+                     + std::accumulate(other.begin(), other.end(), 0LL);
+          } },
+        { "zip.transform.accumulate",
+          n,
+          [&]
+          {
+              return core::zip(core::view(ints), core::view(other))
+                  .transform([](const auto& t) { return static_cast<long long>(std::get<0>(t)) * std::get<1>(t); })
+                  .accumulate(0LL, plus);
+          },
+          [&]
+          {
+              long long sum = 0;
+              for (std::size_t i = 0; i < n; ++i)
+              {
+                  sum += static_cast<long long>(ints[i]) * other[i];
+              }
+              return sum;
+          } },
+        { "view<double>.sum",
+          n,
+          [&] { return static_cast<long long>(core::view(doubles).sum()); },
+          [&]
+          {
+              double sum = 0.0;
+              for (double x : doubles)
+              {
+                  sum += x;
+              }
+              return static_cast<long long>(sum);
+          } },
+        { "view<double>.dot",
+          n,
+          [&] { return static_cast<long long>(core::view(doubles).dot(core::view(doubles))); },
+          [&]
+          {
+              double sum = 0.0;
+              for (double x : doubles)
+              {
+                  sum += x * x;
+              }
+              return static_cast<long long>(sum);
+          } },
+        { "view.filter.minmax",
+          n,
+          [&]
+          {
+              const auto result = core::view(ints).filter(is_even).minmax();
+              return static_cast<long long>(result->second - result->first);
+          },
+          [&]
+          {
+              int min = std::numeric_limits<int>::max();
+              int max = std::numeric_limits<int>::min();
+              for (int x : ints)
+              {
+                  if (is_even(x))
+                  {
+                      min = std::min(min, x);
+                      max = std::max(max, x);
+                  }
+              }
+              return static_cast<long long>(max - min);
+          } },
+        { "view.aggregate_by(x % 1000)",
+          n,
+          [&]
+          {
+              const auto groups = core::view(ints).aggregate_by([](int x) { return x % 1000; }, 0LL, plus);
+              return groups.at(7);
+          },
+          [&]
+          {
+              std::unordered_map<int, long long> groups;
+              for (int x : ints)
+              {
+                  groups[x % 1000] += x;
+              }
+              return groups.at(7);
+          } },
+        { "view.window(16).transform(sum)",
+          n - 15,
+          [&]
+          {
+              return core::view(ints)
+                  .window(16)
+                  .transform([](core::span<int> w) { return std::accumulate(w.begin(), w.end(), 0LL); })
+                  .accumulate(0LL, plus);
+          },
+          [&]
+          {
+              long long sum = 0;
+              for (std::size_t i = 0; i + 16 <= n; ++i)
+              {
+                  sum += std::accumulate(ints.begin() + i, ints.begin() + i + 16, 0LL);
+              }
+              return sum;
+          } },
+        { "view.rolling(16, plus)",
+          n - 15,
+          [&] { return core::view(ints).rolling(16, 0LL, plus).accumulate(0LL, plus); },
+          [&]
+          {
+              long long window = std::accumulate(ints.begin(), ints.begin() + 15, 0LL);
+              long long sum = 0;
+              for (std::size_t i = 15; i < n; ++i)
+              {
+                  window += ints[i];
+                  sum += window;
+                  window -= ints[i - 15];
+              }
+              return sum;
+          } },
+        { "view.rolling_max(1000)",
+          n - 999,
+          [&] { return core::view(other).rolling_max(1000).accumulate(0LL, plus); },
+          [&]
+          {
+              long long sum = 0;
+              for (std::size_t i = 999; i < n; ++i)
+              {
+                  sum += *std::max_element(other.begin() + static_cast<std::ptrdiff_t>(i - 999),
+                                           other.begin() + static_cast<std::ptrdiff_t>(i + 1));
+              }
+              return sum;
+          } },
+        { "merge_sorted(64 shards)",
+          n,
+          [&]
+          {
+              std::vector<core::sequence<const int&>> shards;
+              for (std::size_t shard = 0; shard < 64; ++shard)
+              {
+                  shards.push_back(core::view(ints).drop(static_cast<std::ptrdiff_t>(shard)).step(64));
+              }
+              return core::merge_sorted(shards).accumulate(0LL, fold_in_order);
+          },
+          [&]
+          {
+              std::vector<int> flattened;
+              flattened.reserve(n);
+              for (std::size_t shard = 0; shard < 64; ++shard)
+              {
+                  for (std::size_t i = shard; i < n; i += 64)
+                  {
+                      flattened.push_back(ints[i]);
+                  }
+              }
+              std::sort(flattened.begin(), flattened.end());
+              return std::accumulate(flattened.begin(), flattened.end(), 0LL, fold_in_order);
+          } },
+        { "view.transform.fork_to(sum, max)",
+          n,
+          [&]
+          {
+              struct sum_sink
+              {
+                  long long value = 0;
+
+                  void operator()(long long x)
+                  {
+                      value += x;
+                  }
+              };
+              struct max_sink
+              {
+                  long long value = 0;
+
+                  void operator()(long long x)
+                  {
+                      value = std::max(value, x);
+                  }
+              };
+              const auto [sum, max] = core::view(ints)
+                                          .transform([](int x) { return static_cast<long long>(x) * x; })
+                                          .fork_to(sum_sink{}, max_sink{});
+              return sum.value + max.value;
+          },
+          [&]
+          {
+              long long sum = 0;
+              long long max = 0;
+              for (int x : ints)
+              {
+                  const long long y = static_cast<long long>(x) * x;
+                  sum += y;
+                  max = std::max(max, y);
+              }
+              return sum + max;
+          } },
+        { join_label + ")",
+          n,
+          [&]
+          {
+              return core::hash_join(core::view(build_keys), core::view(probe_keys), identity, identity)
+                  .accumulate(0LL, sum_join);
+          },
+          [&] { return loop_join(); } },
+        { join_label + ", radix_bits 8)",
+          n,
+          [&]
+          {
+              core::join_options options;
+              options.radix_bits = 8;
+              return core::hash_join(core::view(build_keys), core::view(probe_keys), identity, identity, options)
+                  .accumulate(0LL, sum_join);
+          },
+          [&] { return loop_join(); } },
+        { "static_sequence.transform.filter",
+          n,
+          [&] { return core::static_view(ints).transform(square).filter(is_even).accumulate(0LL, plus); },
+          [&]
+          {
+              long long sum = 0;
+              for (int x : ints)
+              {
+                  const long long v = square(x);
+                  sum += is_even(v) ? v : 0;
+              }
+              return sum;
+          } },
+        { "get_lines.transform(size)",
+          line_count,
+          [&]
+          {
+              std::istringstream is{ text };
+              return core::get_lines(is)
+                  .transform([](const std::string& line) { return static_cast<long long>(line.size()); })
+                  .accumulate(0LL, plus);
+          },
+          [&]
+          {
+              std::istringstream is{ text };
+              long long sum = 0;
+              for (std::string line; std::getline(is, line);)
+              {
+                  sum += static_cast<long long>(line.size());
+              }
+              return sum;
+          } },
+        { "mmap_lines.transform(size)",
+          line_count,
+          [&]
+          {
+              return core::mmap_lines(text_path)
+                  .transform([](std::string_view line) { return static_cast<long long>(line.size()); })
+                  .accumulate(0LL, plus);
+          },
+          [&]
+          {
+              std::ifstream is{ text_path };
+              long long sum = 0;
+              for (std::string line; std::getline(is, line);)
+              {
+                  sum += static_cast<long long>(line.size());
+              }
+              return sum;
+          } },
+        { "read_records<int>.accumulate",
+          n,
+          [&]
+          {
+              std::ifstream is{ records_path, std::ios::binary };
+              return core::read_records<int>(is).accumulate(0LL, plus);
+          },
+          [&]
+          {
+              std::ifstream is{ records_path, std::ios::binary };
+              std::vector<int> block(1 << 18);
+              long long sum = 0;
+              while (is.read(reinterpret_cast<char*>(block.data()), block.size() * sizeof(int)) || is.gcount() > 0)
+              {
+                  const auto count = static_cast<std::size_t>(is.gcount()) / sizeof(int);
+                  sum = std::accumulate(block.begin(), block.begin() + count, sum);
+              }
+              return sum;
+          } },
+        { "read_records<int>(double buffered)",
+          n,
+          [&]
+          {
+              std::ifstream is{ records_path, std::ios::binary };
+              return core::read_records<int>(is, core::record_options{ 1 << 20, true }).accumulate(0LL, plus);
+          },
+          [&]
+          {
+              std::ifstream is{ records_path, std::ios::binary };
+              std::vector<int> block(1 << 18);
+              long long sum = 0;
+              while (is.read(reinterpret_cast<char*>(block.data()), block.size() * sizeof(int)) || is.gcount() > 0)
+              {
+                  const auto count = static_cast<std::size_t>(is.gcount()) / sizeof(int);
+                  sum = std::accumulate(block.begin(), block.begin() + count, sum);
+              }
+              return sum;
+          } },
+        { "csv_records.parse_field",
+          line_count,
+          [&]
+          {
+              std::istringstream is{ csv };
+              return core::csv_records(is)
+                  .transform([](core::span<std::string_view> fields) { return core::parse_field<long long>(fields[2]); })
+                  .accumulate(0LL, plus);
+          },
+          [&]
+          {
+              std::istringstream is{ csv };
+              long long sum = 0;
+              for (std::string line; std::getline(is, line);)
+              {
+                  const std::size_t quote_end = line.find('"', line.find('"') + 1);
+                  const std::size_t begin = line.find(',', quote_end) + 1;
+                  long long value = 0;
+                  std::from_chars(line.data() + begin, line.data() + line.size(), value);
+                  sum += value;
+              }
+              return sum;
+          } },
+    };
+
+    print_header();
+    for (const benchmark_t& benchmark : benchmarks)
+    {
+        run(benchmark);
+    }
+    std::filesystem::remove(text_path);
+    std::filesystem::remove(records_path);
+    return 0;
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+namespace ferrugo
+{
+namespace core
+{
+
+// Blocked Bloom filter: all the bits of a key lie in a single cache-line sized block, so a lookup costs one cache
+// miss regardless of the number of hash functions, at the price of a slightly higher false positive rate than a
+// classic Bloom filter of the same size. The memory footprint is fixed at construction.
+template <class Key, class Hash = std::hash<Key>>
+class bloom_filter
+{
+public:
+    static constexpr std::size_t block_bits = 512;
+    static constexpr std::size_t max_hash_count = 16;
+
+    // The number of bits is rounded up to a power of two number of blocks.
+    bloom_filter(std::size_t bit_count, std::size_t hash_count, Hash hash = {})
+        : m_blocks(block_count_for(bit_count))
+        , m_hash_count(hash_count)
+        , m_hash(std::move(hash))
+    {
+        if (hash_count == 0 || hash_count > max_hash_count)
+        {
+            throw std::invalid_argument{ "bloom_filter: hash_count must be in [1, 16]" };
+        }
+    }
+
+    // Filter sized for expected_count keys to be reported as present with at most about the given probability when
+    // they are not.
+    static auto for_capacity(std::size_t expected_count, double false_positive_rate, Hash hash = {}) -> bloom_filter
+    {
+        if (!(false_positive_rate > 0.0 && false_positive_rate < 1.0))
+        {
+            throw std::invalid_argument{ "bloom_filter: false_positive_rate must be in (0, 1)" };
+        }
+        const double ln2 = std::log(2.0);
+        const double n = static_cast<double>(std::max<std::size_t>(expected_count, 1));
+        const double bits = std::ceil(-n * std::log(false_positive_rate) / (ln2 * ln2));
+        const auto hash_count = static_cast<std::size_t>(std::lround(bits / n * ln2));
+        return bloom_filter{ static_cast<std::size_t>(bits),
+                             std::clamp<std::size_t>(hash_count, 1, max_hash_count),
+                             std::move(hash) };
+    }
+
+    auto bit_count() const -> std::size_t
+    {
+        return m_blocks.size() * block_bits;
+    }
+
+    auto hash_count() const -> std::size_t
+    {
+        return m_hash_count;
+    }
+
+    // False positives are possible, false negatives are not.
+    auto contains(const Key& key) const -> bool
+    {
+        const probe p = make_probe(key);
+        const block& b = m_blocks[p.block];
+        for (std::size_t i = 0; i < m_hash_count; ++i)
+        {
+            const std::size_t bit = p.bit(i);
+            if ((b.words[bit / 64] & (std::uint64_t{ 1 } << (bit % 64))) == 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Adds the key; returns true if it was certainly not present before.
+    auto insert(const Key& key) -> bool
+    {
+        const probe p = make_probe(key);
+        block& b = m_blocks[p.block];
+        bool inserted = false;
+        for (std::size_t i = 0; i < m_hash_count; ++i)
+        {
+            const std::size_t bit = p.bit(i);
+            const std::uint64_t mask = std::uint64_t{ 1 } << (bit % 64);
+            inserted |= (b.words[bit / 64] & mask) == 0;
+            b.words[bit / 64] |= mask;
+        }
+        return inserted;
+    }
+
+    void clear()
+    {
+        std::fill(m_blocks.begin(), m_blocks.end(), block{});
+    }
+
+private:
+    struct alignas(64) block
+    {
+        std::uint64_t words[block_bits / 64] = {};
+    };
+
+    // Positions of the bits of a key: the block, and double hashing within the block. The stride is odd, so the
+    // positions are distinct.
+    struct probe
+    {
+        std::size_t block;
+        std::uint64_t first;
+        std::uint64_t stride;
+
+        auto bit(std::size_t i) const -> std::size_t
+        {
+            return static_cast<std::size_t>((first + i * stride) % block_bits);
+        }
+    };
+
+    static auto block_count_for(std::size_t bit_count) -> std::size_t
+    {
+        std::size_t count = 1;
+        while (count * block_bits < bit_count)
+        {
+            count *= 2;
+        }
+        return count;
+    }
+
+    // Finalizer of splitmix64; spreads the identity hashes of std::hash.
+    static auto mix(std::uint64_t x) -> std::uint64_t
+    {
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    auto make_probe(const Key& key) const -> probe
+    {
+        const std::uint64_t h = mix(static_cast<std::uint64_t>(m_hash(key)));
+        const std::uint64_t g = mix(h ^ 0x9E3779B97F4A7C15ull);
+        return probe{ static_cast<std::size_t>(h & (m_blocks.size() - 1)), g, (g >> 32) | 1 };
+    }
+
+    std::vector<block> m_blocks;
+    std::size_t m_hash_count;
+    Hash m_hash;
+};
+
+}  // namespace core
+}  // namespace ferrugo
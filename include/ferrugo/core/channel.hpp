@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <condition_variable>
 #include <deque>
 #include <mutex>
@@ -70,7 +71,7 @@ struct channel
             throw std::runtime_error{ "sending to a closed channel" };
         }
 
-        m_queue.push_back(value);
+        m_queue.push_back(std::move(value));
         m_cond_is_empty.notify_one();
     }
 
@@ -91,7 +92,7 @@ struct channel
             return false;
         }
 
-        m_queue.push_back(value);
+        m_queue.push_back(std::move(value));
         m_cond_is_empty.notify_one();
         return true;
     }
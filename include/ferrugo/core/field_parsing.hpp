@@ -0,0 +1,207 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <ferrugo/core/iterator_range.hpp>
+#include <ferrugo/core/maybe.hpp>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ferrugo
+{
+namespace core
+{
+
+namespace detail
+{
+
+// Finds ch eight bytes at a time (SWAR): a word contains ch iff word ^ pattern has a zero byte, which the classic
+// (x - 0x01..) & ~x & 0x80.. test detects without branching per byte.
+inline auto find_byte(const char* b, const char* e, char ch) -> const char*
+{
+    static constexpr std::uint64_t ones = 0x0101010101010101ull;
+    static constexpr std::uint64_t highs = 0x8080808080808080ull;
+    const std::uint64_t pattern = ones * static_cast<unsigned char>(ch);
+    while (e - b >= 8)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, b, sizeof(word));
+        const std::uint64_t x = word ^ pattern;
+        if (((x - ones) & ~x & highs) != 0)
+        {
+            break;
+        }
+        b += 8;
+    }
+    while (b != e && *b != ch)
+    {
+        ++b;
+    }
+    return b;
+}
+
+// Splits delimited records into fields. A field starting with the quote character extends to the matching closing
+// quote and may contain delimiters, line breaks and doubled quotes, which stand for a single one. Fields are views of
+// the record, except for the quoted fields containing doubled quotes, which are unescaped into an internal buffer;
+// they stay valid until the next split.
+class field_splitter
+{
+public:
+    field_splitter(char delim, char quote) : m_delim(delim), m_quote(quote)
+    {
+    }
+
+    // Returns false if the record ends inside a quoted field.
+    auto split(std::string_view record) -> bool
+    {
+        m_fields.clear();
+        m_unescaped.clear();
+        // The unescaped fields are never longer than the record, so the buffer is not reallocated while splitting.
+        m_unescaped.reserve(record.size());
+        const char* pos = record.data();
+        const char* const end = pos + record.size();
+        while (true)
+        {
+            if (pos != end && *pos == m_quote)
+            {
+                if (!quoted_field(pos, end))
+                {
+                    return false;
+                }
+                if (pos != end && *pos != m_delim)
+                {
+                    throw std::runtime_error{ "split_fields: unexpected character after a quoted field" };
+                }
+            }
+            else
+            {
+                const char* const field_end = find_byte(pos, end, m_delim);
+                m_fields.emplace_back(pos, static_cast<std::size_t>(field_end - pos));
+                pos = field_end;
+            }
+            if (pos == end)
+            {
+                return true;
+            }
+            ++pos;
+        }
+    }
+
+    auto fields() const -> span<std::string_view>
+    {
+        return span<std::string_view>{ m_fields.data(), static_cast<std::ptrdiff_t>(m_fields.size()) };
+    }
+
+private:
+    // pos points at the opening quote; on success it is moved past the closing one.
+    auto quoted_field(const char*& pos, const char* end) -> bool
+    {
+        const char* begin = pos + 1;
+        const char* close = find_byte(begin, end, m_quote);
+        if (close == end)
+        {
+            return false;
+        }
+        if (close + 1 == end || close[1] != m_quote)
+        {
+            m_fields.emplace_back(begin, static_cast<std::size_t>(close - begin));
+            pos = close + 1;
+            return true;
+        }
+
+        const std::size_t start = m_unescaped.size();
+        while (close + 1 != end && close[1] == m_quote)
+        {
+            m_unescaped.append(begin, close + 1);
+            begin = close + 2;
+            close = find_byte(begin, end, m_quote);
+            if (close == end)
+            {
+                return false;
+            }
+        }
+        m_unescaped.append(begin, close);
+        m_fields.emplace_back(m_unescaped.data() + start, m_unescaped.size() - start);
+        pos = close + 1;
+        return true;
+    }
+
+    char m_delim;
+    char m_quote;
+    std::vector<std::string_view> m_fields = {};
+    std::string m_unescaped = {};
+};
+
+template <class... Ts>
+struct parse_row_fn;
+
+}  // namespace detail
+
+// Converts a field to T: numbers are parsed with std::from_chars and must span the whole field, strings are copied
+// (std::string_view refers to the field itself), and for maybe<U> an empty field is none.
+template <class T>
+auto parse_field(std::string_view field) -> T
+{
+    if constexpr (std::is_same_v<T, std::string>)
+    {
+        return std::string{ field };
+    }
+    else if constexpr (std::is_same_v<T, std::string_view>)
+    {
+        return field;
+    }
+    else if constexpr (is_maybe<T>::value)
+    {
+        return field.empty() ? T{} : T{ parse_field<typename T::value_type>(field) };
+    }
+    else
+    {
+        static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, "unsupported field type");
+        T value = {};
+        const char* const end = field.data() + field.size();
+        const auto [ptr, ec] = std::from_chars(field.data(), end, value);
+        if (ec != std::errc{} || ptr != end)
+        {
+            throw std::invalid_argument{ "parse_field: invalid value \"" + std::string{ field } + "\"" };
+        }
+        return value;
+    }
+}
+
+namespace detail
+{
+
+template <class... Ts>
+struct parse_row_fn
+{
+    auto operator()(span<std::string_view> fields) const -> std::tuple<Ts...>
+    {
+        if (fields.size() != static_cast<std::ptrdiff_t>(sizeof...(Ts)))
+        {
+            throw std::invalid_argument{ "parse_row: expected " + std::to_string(sizeof...(Ts)) + " fields, got "
+                                         + std::to_string(fields.size()) };
+        }
+        return parse(fields.begin(), std::index_sequence_for<Ts...>{});
+    }
+
+    template <std::size_t... I>
+    static auto parse(const std::string_view* fields, std::index_sequence<I...>) -> std::tuple<Ts...>
+    {
+        return std::tuple<Ts...>{ parse_field<Ts>(fields[I])... };
+    }
+};
+
+}  // namespace detail
+
+// Converts the fields of a record to a tuple; the number of fields must match.
+template <class... Ts>
+static constexpr inline auto parse_row = detail::parse_row_fn<Ts...>{};
+
+}  // namespace core
+}  // namespace ferrugo
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace ferrugo
+{
+namespace core
+{
+
+// Open-addressing hash map. Entries are stored densely in insertion order, next to their hashes; the probe table
+// holds only entry indices and uses linear probing, so lookups touch a couple of contiguous arrays instead of
+// chasing nodes. Erasing single entries is not supported.
+template <class Key, class Value, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key>>
+class flat_hash_map
+{
+public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using value_type = std::pair<Key, Value>;
+    using size_type = std::size_t;
+    using iterator = typename std::vector<value_type>::iterator;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+
+    flat_hash_map() = default;
+
+    explicit flat_hash_map(size_type capacity, Hash hash = {}, KeyEqual key_equal = {})
+        : m_hash(std::move(hash))
+        , m_key_equal(std::move(key_equal))
+    {
+        reserve(capacity);
+    }
+
+    auto begin() -> iterator
+    {
+        return m_entries.begin();
+    }
+
+    auto end() -> iterator
+    {
+        return m_entries.end();
+    }
+
+    auto begin() const -> const_iterator
+    {
+        return m_entries.begin();
+    }
+
+    auto end() const -> const_iterator
+    {
+        return m_entries.end();
+    }
+
+    auto size() const -> size_type
+    {
+        return m_entries.size();
+    }
+
+    auto empty() const -> bool
+    {
+        return m_entries.empty();
+    }
+
+    // Number of entries which fit without growing the probe table.
+    auto capacity() const -> size_type
+    {
+        return m_slots.size() / 8 * 7;
+    }
+
+    void reserve(size_type n)
+    {
+        m_entries.reserve(n);
+        m_hashes.reserve(n);
+        if (n > capacity())
+        {
+            size_type slot_count = 8;
+            while (slot_count / 8 * 7 < n)
+            {
+                slot_count *= 2;
+            }
+            rehash(slot_count);
+        }
+    }
+
+    // Removes all the entries, keeping the allocated memory.
+    void clear()
+    {
+        m_entries.clear();
+        m_hashes.clear();
+        std::fill(m_slots.begin(), m_slots.end(), empty_slot);
+    }
+
+    auto find(const Key& key) -> iterator
+    {
+        const size_type slot = find_slot(key, m_hash(key));
+        return m_slots.empty() || m_slots[slot] == empty_slot ? end() : begin() + (m_slots[slot] - 1);
+    }
+
+    auto find(const Key& key) const -> const_iterator
+    {
+        const size_type slot = find_slot(key, m_hash(key));
+        return m_slots.empty() || m_slots[slot] == empty_slot ? end() : begin() + (m_slots[slot] - 1);
+    }
+
+    auto contains(const Key& key) const -> bool
+    {
+        return find(key) != end();
+    }
+
+    auto at(const Key& key) -> Value&
+    {
+        const iterator it = find(key);
+        if (it == end())
+        {
+            throw std::out_of_range{ "flat_hash_map::at - key not found" };
+        }
+        return it->second;
+    }
+
+    auto at(const Key& key) const -> const Value&
+    {
+        const const_iterator it = find(key);
+        if (it == end())
+        {
+            throw std::out_of_range{ "flat_hash_map::at - key not found" };
+        }
+        return it->second;
+    }
+
+    // Inserts an entry constructed from args unless the key is already present. Iterators and references to the
+    // entries are invalidated by insertions.
+    template <class... Args>
+    auto try_emplace(Key key, Args&&... args) -> std::pair<iterator, bool>
+    {
+        const size_type hash = m_hash(key);
+        if (m_slots.empty())
+        {
+            rehash(8);
+        }
+        size_type slot = find_slot(key, hash);
+        if (m_slots[slot] != empty_slot)
+        {
+            return { begin() + (m_slots[slot] - 1), false };
+        }
+        if (size() + 1 > capacity())
+        {
+            rehash(m_slots.size() * 2);
+            slot = find_slot(key, hash);
+        }
+        m_entries.emplace_back(
+            std::piecewise_construct,
+            std::forward_as_tuple(std::move(key)),
+            std::forward_as_tuple(std::forward<Args>(args)...));
+        m_hashes.push_back(hash);
+        m_slots[slot] = m_entries.size();
+        return { std::prev(end()), true };
+    }
+
+    auto operator[](Key key) -> Value&
+    {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+private:
+    static constexpr size_type empty_slot = 0;
+
+    // Fibonacci hashing spreads the identity hashes of std::hash over the whole table.
+    auto home_slot(size_type hash) const -> size_type
+    {
+        return static_cast<size_type>((static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ull) >> m_shift);
+    }
+
+    // Slot holding the key, or the empty slot ending its probe sequence.
+    auto find_slot(const Key& key, size_type hash) const -> size_type
+    {
+        if (m_slots.empty())
+        {
+            return 0;
+        }
+        const size_type mask = m_slots.size() - 1;
+        size_type slot = home_slot(hash);
+        while (m_slots[slot] != empty_slot)
+        {
+            const size_type index = m_slots[slot] - 1;
+            if (m_hashes[index] == hash && m_key_equal(m_entries[index].first, key))
+            {
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    void rehash(size_type slot_count)
+    {
+        m_slots.assign(slot_count, empty_slot);
+        m_shift = 64;
+        for (size_type n = slot_count; n > 1; n /= 2)
+        {
+            --m_shift;
+        }
+        const size_type mask = slot_count - 1;
+        for (size_type index = 0; index < m_entries.size(); ++index)
+        {
+            size_type slot = home_slot(m_hashes[index]);
+            while (m_slots[slot] != empty_slot)
+            {
+                slot = (slot + 1) & mask;
+            }
+            m_slots[slot] = index + 1;
+        }
+    }
+
+    std::vector<value_type> m_entries = {};
+    std::vector<size_type> m_hashes = {};
+    std::vector<size_type> m_slots = {};
+    unsigned m_shift = 64;
+    Hash m_hash = {};
+    KeyEqual m_key_equal = {};
+};
+
+// Hash set with the layout of flat_hash_map: keys are stored densely in insertion order.
+template <class Key, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key>>
+class flat_hash_set
+{
+    struct unit
+    {
+    };
+
+    using map_type = flat_hash_map<Key, unit, Hash, KeyEqual>;
+
+public:
+    using key_type = Key;
+    using value_type = Key;
+    using size_type = std::size_t;
+
+    flat_hash_set() = default;
+
+    explicit flat_hash_set(size_type capacity, Hash hash = {}, KeyEqual key_equal = {})
+        : m_map(capacity, std::move(hash), std::move(key_equal))
+    {
+    }
+
+    auto size() const -> size_type
+    {
+        return m_map.size();
+    }
+
+    auto empty() const -> bool
+    {
+        return m_map.empty();
+    }
+
+    auto capacity() const -> size_type
+    {
+        return m_map.capacity();
+    }
+
+    void reserve(size_type n)
+    {
+        m_map.reserve(n);
+    }
+
+    void clear()
+    {
+        m_map.clear();
+    }
+
+    auto contains(const Key& key) const -> bool
+    {
+        return m_map.contains(key);
+    }
+
+    // Returns true if the key was not present.
+    auto insert(Key key) -> bool
+    {
+        return m_map.try_emplace(std::move(key)).second;
+    }
+
+private:
+    map_type m_map = {};
+};
+
+}  // namespace core
+}  // namespace ferrugo
@@ -1,12 +1,38 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <ferrugo/core/bloom_filter.hpp>
+#include <ferrugo/core/channel.hpp>
+#include <ferrugo/core/field_parsing.hpp>
+#include <ferrugo/core/flat_hash_map.hpp>
+#include <ferrugo/core/iterator_range.hpp>
 #include <ferrugo/core/maybe.hpp>
+#include <ferrugo/core/sequence_profile.hpp>
 #include <ferrugo/core/type_traits.hpp>
 #include <functional>
 #include <istream>
+#include <limits>
 #include <memory>
+#include <new>
+#include <mutex>
 #include <numeric>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 namespace ferrugo
 {
@@ -16,597 +42,3543 @@ namespace core
 template <class T>
 using iteration_result_t = maybe<T>;
 
+// Bounds on the number of elements a stage is yet to produce. An unknown upper bound means the sequence may be
+// infinite; lower == upper means the length is known exactly.
+struct size_hint_t
+{
+    std::size_t lower = 0;
+    maybe<std::size_t> upper = {};
+
+    static auto exact(std::size_t n) -> size_hint_t
+    {
+        return size_hint_t{ n, n };
+    }
+
+    static auto infinite() -> size_hint_t
+    {
+        return size_hint_t{ std::numeric_limits<std::size_t>::max(), {} };
+    }
+};
+
+namespace detail
+{
+
+inline auto saturating_add(std::size_t lhs, std::size_t rhs) -> std::size_t
+{
+    return lhs > std::numeric_limits<std::size_t>::max() - rhs ? std::numeric_limits<std::size_t>::max() : lhs + rhs;
+}
+
+inline auto saturating_mul(std::size_t lhs, std::size_t rhs) -> std::size_t
+{
+    return rhs != 0 && lhs > std::numeric_limits<std::size_t>::max() / rhs ? std::numeric_limits<std::size_t>::max()
+                                                                           : lhs * rhs;
+}
+
+inline auto saturating_sub(std::size_t lhs, std::size_t rhs) -> std::size_t
+{
+    return lhs > rhs ? lhs - rhs : 0;
+}
+
+inline auto min_upper(const maybe<std::size_t>& lhs, const maybe<std::size_t>& rhs) -> maybe<std::size_t>
+{
+    if (lhs && rhs)
+    {
+        return std::min(*lhs, *rhs);
+    }
+    return lhs ? lhs : rhs;
+}
+
+}  // namespace detail
+
+// Number of elements pulled at once by the batched terminal operations.
+static constexpr inline std::size_t default_batch_size = 128;
+
+// Elements which may point into a buffer owned by the stage producing them (e.g. the windows yielded by chunk and
+// window) are valid only until the next pull, so they are never pulled ahead in batches.
+template <class T>
+struct is_transient : std::false_type
+{
+};
+
+template <class T>
+struct is_transient<iterator_range<T*>> : std::true_type
+{
+};
+
+namespace detail
+{
+
+template <class Iter, class V = std::remove_cv_t<iter_value_t<Iter>>>
+struct is_contiguous_iterator
+    : std::bool_constant<
+          std::is_pointer_v<Iter>
+          || (!std::is_same_v<V, bool>
+              && (std::is_same_v<Iter, typename std::vector<V>::iterator>
+                  || std::is_same_v<Iter, typename std::vector<V>::const_iterator>))
+          || std::is_same_v<Iter, std::string::iterator> || std::is_same_v<Iter, std::string::const_iterator>>
+{
+};
+
+}  // namespace detail
+
+namespace detail
+{
+
+template <class Container, class T>
+using push_back_impl = decltype(std::declval<Container&>().push_back(std::declval<T>()));
+
+template <class Container>
+using reserve_impl = decltype(std::declval<Container&>().reserve(std::size_t{}));
+
+template <class F>
+using advance_impl = decltype(std::declval<const F&>().advance(std::size_t{}));
+
+template <class F>
+using contiguous_impl = decltype(std::declval<const F&>().contiguous());
+
+template <class F>
+using size_hint_impl = decltype(std::declval<const F&>().size_hint());
+
+template <class F>
+using split_impl = decltype(std::declval<const F&>().split(std::size_t{}));
+
+template <class F, class T>
+using next_batch_impl = decltype(std::declval<const F&>().next_batch(std::declval<iteration_result_t<T>*>(), std::size_t{}));
+
+}  // namespace detail
+
+// Non-owning reference to a callable receiving the elements pushed by a stage; it returns false to stop the iteration.
+template <class T>
+class sink_ref
+{
+public:
+    template <class F, require<!std::is_same_v<std::decay_t<F>, sink_ref>> = 0>
+    sink_ref(F&& func) noexcept
+        : m_func(const_cast<void*>(static_cast<const void*>(std::addressof(func))))
+        , m_call(&call<std::remove_reference_t<F>>)
+    {
+    }
+
+    auto operator()(T&& item) const -> bool
+    {
+        return m_call(m_func, std::forward<T>(item));
+    }
+
+private:
+    template <class F>
+    static auto call(void* func, T&& item) -> bool
+    {
+        return std::invoke(*static_cast<F*>(func), std::forward<T>(item));
+    }
+
+    void* m_func;
+    bool (*m_call)(void*, T&&);
+};
+
+namespace detail
+{
+
+template <class F, class T>
+using push_impl = decltype(std::declval<const F&>().push(std::declval<sink_ref<T>>()));
+
+}  // namespace detail
+
+// Type-erased next function. Besides pulling a single element, every stage can be asked to fill a caller-provided
+// buffer with up to n elements through next_batch. Stages providing a native next_batch are called directly, the
+// other ones fall back to single pulls. next_batch returns the number of elements written; 0 means the end.
+// Similarly, advance(n) skips up to n elements and returns how many were skipped; random-access sources and
+// index-preserving stages implement it in O(1), the other ones discard pulled elements. Stages whose remaining
+// elements are stored in contiguous memory expose them through contiguous(), for the numeric reductions.
+// Terminals run the pipeline in push mode: push(sink) makes the stage loop over its elements and hand each to the
+// sink until it returns false, and returns false iff the sink did. Sources and adaptors implementing push natively
+// call the sink of the downstream stage directly, with no maybe per element and stage; the other ones fall back to
+// single pulls.
+// split(parts) divides the remaining elements into at most parts consecutive ranges, each served by an independent
+// next function, so that the parallel terminals can run a copy of the pipeline per range; random-access sources and
+// the element-wise adaptors with stateless callables (see detail::is_stateless) above them implement it, the other
+// stages return no parts.
+//
+// Stages up to inline_size bytes are stored in place, larger ones on the heap; moving never allocates. A sequence, and
+// with it every stage, is copied by the const& terminals, so stages must be copyable; this is checked when a stage is
+// stored, since the copy itself is type-erased. State which cannot be copied is shared through a std::shared_ptr.
+template <class T>
+class any_next_function
+{
+public:
+    using result_type = iteration_result_t<T>;
+
+    static constexpr std::size_t inline_size = 64;
+
+    any_next_function() noexcept = default;
+
+    template <
+        class F,
+        require<!std::is_same_v<std::decay_t<F>, any_next_function>> = 0,
+        require<std::is_invocable_r_v<result_type, const std::decay_t<F>&>> = 0,
+        require<std::is_copy_constructible_v<std::decay_t<F>>> = 0>
+    any_next_function(F&& func)
+    {
+        using impl = impl_t<std::decay_t<F>>;
+        impl::create(m_storage, std::forward<F>(func));
+        m_vtable = &impl::vtable;
+    }
+
+    any_next_function(const any_next_function& other)
+    {
+        if (other.m_vtable)
+        {
+            other.m_vtable->copy(other.m_storage, m_storage);
+            m_vtable = other.m_vtable;
+        }
+    }
+
+    any_next_function(any_next_function&& other) noexcept
+    {
+        take(other);
+    }
+
+    ~any_next_function()
+    {
+        reset();
+    }
+
+    any_next_function& operator=(const any_next_function& other)
+    {
+        if (this != &other)
+        {
+            *this = any_next_function{ other };
+        }
+        return *this;
+    }
+
+    any_next_function& operator=(any_next_function&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return m_vtable != nullptr;
+    }
+
+    auto operator()() const -> result_type
+    {
+        return get().call(m_storage);
+    }
+
+    auto next_batch(result_type* out, std::size_t n) const -> std::size_t
+    {
+        return get().next_batch(m_storage, out, n);
+    }
+
+    auto size_hint() const -> size_hint_t
+    {
+        return m_vtable ? m_vtable->size_hint(m_storage) : size_hint_t::exact(0);
+    }
+
+    auto advance(std::size_t n) const -> std::size_t
+    {
+        return get().advance(m_storage, n);
+    }
+
+    auto contiguous() const -> maybe<span<std::decay_t<T>>>
+    {
+        return m_vtable ? m_vtable->contiguous(m_storage) : maybe<span<std::decay_t<T>>>{};
+    }
+
+    auto push(sink_ref<T> sink) const -> bool
+    {
+        return get().push(m_storage, sink);
+    }
+
+    auto split(std::size_t parts) const -> std::vector<any_next_function>
+    {
+        return m_vtable ? m_vtable->split(m_storage, parts) : std::vector<any_next_function>{};
+    }
+
+private:
+    union storage_t
+    {
+        alignas(std::max_align_t) unsigned char m_buffer[inline_size];
+        void* m_heap;
+    };
+
+    struct vtable_t
+    {
+        auto (*call)(const storage_t&) -> result_type;
+        auto (*next_batch)(const storage_t&, result_type*, std::size_t) -> std::size_t;
+        auto (*size_hint)(const storage_t&) -> size_hint_t;
+        auto (*advance)(const storage_t&, std::size_t) -> std::size_t;
+        auto (*contiguous)(const storage_t&) -> maybe<span<std::decay_t<T>>>;
+        auto (*push)(const storage_t&, sink_ref<T>) -> bool;
+        auto (*split)(const storage_t&, std::size_t) -> std::vector<any_next_function>;
+        void (*copy)(const storage_t&, storage_t&);
+        void (*move)(storage_t&, storage_t&) noexcept;
+        void (*destroy)(storage_t&) noexcept;
+    };
+
+    template <class F>
+    struct impl_t
+    {
+        static constexpr bool is_inline = sizeof(F) <= inline_size && alignof(F) <= alignof(std::max_align_t)
+                                          && std::is_nothrow_move_constructible_v<F>;
+
+        static auto get(const storage_t& storage) -> const F&
+        {
+            if constexpr (is_inline)
+            {
+                return *std::launder(reinterpret_cast<const F*>(storage.m_buffer));
+            }
+            else
+            {
+                return *static_cast<const F*>(storage.m_heap);
+            }
+        }
+
+        template <class... Args>
+        static void create(storage_t& storage, Args&&... args)
+        {
+            if constexpr (is_inline)
+            {
+                ::new (static_cast<void*>(storage.m_buffer)) F(std::forward<Args>(args)...);
+            }
+            else
+            {
+                storage.m_heap = new F(std::forward<Args>(args)...);
+            }
+        }
+
+        static auto call(const storage_t& storage) -> result_type
+        {
+            return std::invoke(get(storage));
+        }
+
+        static auto next_batch(const storage_t& storage, result_type* out, std::size_t n) -> std::size_t
+        {
+            const F& func = get(storage);
+            if constexpr (is_detected<detail::next_batch_impl, F, T>::value)
+            {
+                return func.next_batch(out, n);
+            }
+            else
+            {
+                const std::size_t limit = is_transient<std::decay_t<T>>::value ? std::min<std::size_t>(n, 1) : n;
+                std::size_t count = 0;
+                for (; count < limit; ++count)
+                {
+                    result_type next = std::invoke(func);
+                    if (!next)
+                    {
+                        break;
+                    }
+                    out[count] = std::move(next);
+                }
+                return count;
+            }
+        }
+
+        static auto size_hint(const storage_t& storage) -> size_hint_t
+        {
+            if constexpr (is_detected<detail::size_hint_impl, F>::value)
+            {
+                return get(storage).size_hint();
+            }
+            else
+            {
+                return size_hint_t{};
+            }
+        }
+
+        static auto advance(const storage_t& storage, std::size_t n) -> std::size_t
+        {
+            const F& func = get(storage);
+            if constexpr (is_detected<detail::advance_impl, F>::value)
+            {
+                return func.advance(n);
+            }
+            else
+            {
+                std::size_t count = 0;
+                while (count < n && std::invoke(func))
+                {
+                    ++count;
+                }
+                return count;
+            }
+        }
+
+        static auto contiguous(const storage_t& storage) -> maybe<span<std::decay_t<T>>>
+        {
+            if constexpr (is_detected<detail::contiguous_impl, F>::value)
+            {
+                return get(storage).contiguous();
+            }
+            else
+            {
+                return {};
+            }
+        }
+
+        static auto push(const storage_t& storage, sink_ref<T> sink) -> bool
+        {
+            const F& func = get(storage);
+            if constexpr (is_detected<detail::push_impl, F, T>::value)
+            {
+                return func.push(sink);
+            }
+            else
+            {
+                while (true)
+                {
+                    result_type next = std::invoke(func);
+                    if (!next)
+                    {
+                        return true;
+                    }
+                    if (!sink(*std::move(next)))
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+
+        static auto split(const storage_t& storage, std::size_t parts) -> std::vector<any_next_function>
+        {
+            if constexpr (is_detected<detail::split_impl, F>::value)
+            {
+                return get(storage).split(parts);
+            }
+            else
+            {
+                return {};
+            }
+        }
+
+        static void copy(const storage_t& from, storage_t& to)
+        {
+            create(to, get(from));
+        }
+
+        static void move(storage_t& from, storage_t& to) noexcept
+        {
+            if constexpr (is_inline)
+            {
+                create(to, std::move(const_cast<F&>(get(from))));
+                destroy(from);
+            }
+            else
+            {
+                to.m_heap = std::exchange(from.m_heap, nullptr);
+            }
+        }
+
+        static void destroy(storage_t& storage) noexcept
+        {
+            if constexpr (is_inline)
+            {
+                get(storage).~F();
+            }
+            else
+            {
+                delete static_cast<F*>(storage.m_heap);
+            }
+        }
+
+        static constexpr vtable_t vtable
+            = { &call, &next_batch, &size_hint, &advance, &contiguous, &push, &split, &copy, &move, &destroy };
+    };
+
+    auto get() const -> const vtable_t&
+    {
+        if (!m_vtable)
+        {
+            throw std::bad_function_call{};
+        }
+        return *m_vtable;
+    }
+
+    void take(any_next_function& other) noexcept
+    {
+        if (other.m_vtable)
+        {
+            other.m_vtable->move(other.m_storage, m_storage);
+            m_vtable = std::exchange(other.m_vtable, nullptr);
+        }
+    }
+
+    void reset() noexcept
+    {
+        if (m_vtable)
+        {
+            std::exchange(m_vtable, nullptr)->destroy(m_storage);
+        }
+    }
+
+    storage_t m_storage;
+    const vtable_t* m_vtable = nullptr;
+};
+
+template <class T>
+using next_function_t = any_next_function<T>;
+
+namespace detail
+{
+
+// Pushes the elements of next_fn to sink, a callable returning false to stop, like any_next_function::push.
+// Contiguous sources are looped over directly, which spares the indirect call per element and keeps the sink inlined;
+// a stage yielding mutable references exposes the very elements it yields, hence the const_cast.
+template <class T, class Sink>
+auto push_to(const next_function_t<T>& next_fn, Sink&& sink) -> bool
+{
+    if constexpr (std::is_lvalue_reference_v<T> || std::is_convertible_v<const std::decay_t<T>&, T>)
+    {
+        if (const maybe<span<std::decay_t<T>>> data = next_fn.contiguous())
+        {
+            std::size_t count = 0;
+            for (const std::decay_t<T>& item : *data)
+            {
+                ++count;
+                if (!sink(static_cast<T>(const_cast<std::decay_t<T>&>(item))))
+                {
+                    next_fn.advance(count);
+                    return false;
+                }
+            }
+            next_fn.advance(count);
+            return true;
+        }
+    }
+    return next_fn.push(sink);
+}
+
+// Calls func for every element, in push mode.
+template <class T, class Func>
+void for_each_pushed(const next_function_t<T>& next_fn, Func&& func)
+{
+    push_to(
+        next_fn,
+        [&](T&& item)
+        {
+            std::invoke(func, std::forward<T>(item));
+            return true;
+        });
+}
+
+// Bounds of the index-th of parts consecutive ranges of nearly equal lengths covering [0, count).
+inline auto part_bounds(std::size_t count, std::size_t parts, std::size_t index) -> std::pair<std::size_t, std::size_t>
+{
+    const std::size_t length = count / parts;
+    const std::size_t extra = count % parts;
+    return { length * index + std::min(index, extra), length * (index + 1) + std::min(index + 1, extra) };
+}
+
+// Callables which the element-wise adaptors copy into every part of a split, where the copies run concurrently:
+// captureless lambdas, other empty function objects and function pointers. Any other callable may hold state, or
+// refer to some, so the adaptors calling it do not split and the parallel terminals pull from them under a lock.
+template <class F>
+struct is_stateless
+    : std::disjunction<std::is_empty<F>, std::conjunction<std::is_pointer<F>, std::is_function<std::remove_pointer_t<F>>>>
+{
+};
+
+// split for the element-wise adaptors: splits the upstream and wraps every part with make, which gives it its own
+// copy of the adaptor.
+template <class Out, class In, class Make>
+auto split_each(const next_function_t<In>& next_fn, std::size_t parts, Make make) -> std::vector<next_function_t<Out>>
+{
+    std::vector<next_function_t<Out>> result;
+    for (next_function_t<In>& part : next_fn.split(parts))
+    {
+        result.emplace_back(make(std::move(part)));
+    }
+    return result;
+}
+
+// Reduction kernels over contiguous blocks. Each keeps reduction_lanes independent accumulators, which breaks the
+// dependency chain of a sequential reduction and lets the compiler vectorise the inner loop without -ffast-math.
+// For floating point values the result may therefore differ from a sequential reduction in the last bits.
+static constexpr inline std::size_t reduction_lanes = 8;
+
+template <class Acc, class V>
+auto sum_kernel(const V* data, std::size_t n) -> Acc
+{
+    Acc acc[reduction_lanes] = {};
+    std::size_t i = 0;
+    for (; i + reduction_lanes <= n; i += reduction_lanes)
+    {
+        for (std::size_t lane = 0; lane < reduction_lanes; ++lane)
+        {
+            acc[lane] += static_cast<Acc>(data[i + lane]);
+        }
+    }
+    for (; i < n; ++i)
+    {
+        acc[0] += static_cast<Acc>(data[i]);
+    }
+    return ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+}
+
+template <class Acc, class L, class R>
+auto dot_kernel(const L* lhs, const R* rhs, std::size_t n) -> Acc
+{
+    Acc acc[reduction_lanes] = {};
+    std::size_t i = 0;
+    for (; i + reduction_lanes <= n; i += reduction_lanes)
+    {
+        for (std::size_t lane = 0; lane < reduction_lanes; ++lane)
+        {
+            acc[lane] += static_cast<Acc>(lhs[i + lane]) * static_cast<Acc>(rhs[i + lane]);
+        }
+    }
+    for (; i < n; ++i)
+    {
+        acc[0] += static_cast<Acc>(lhs[i]) * static_cast<Acc>(rhs[i]);
+    }
+    return ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+}
+
+// Folds data into the running minimum and maximum; no special care is taken of NaNs.
+template <class V>
+void minmax_kernel(const V* data, std::size_t n, V& min, V& max)
+{
+    V mins[reduction_lanes];
+    V maxs[reduction_lanes];
+    std::fill(std::begin(mins), std::end(mins), min);
+    std::fill(std::begin(maxs), std::end(maxs), max);
+    std::size_t i = 0;
+    for (; i + reduction_lanes <= n; i += reduction_lanes)
+    {
+        for (std::size_t lane = 0; lane < reduction_lanes; ++lane)
+        {
+            const V value = data[i + lane];
+            mins[lane] = value < mins[lane] ? value : mins[lane];
+            maxs[lane] = maxs[lane] < value ? value : maxs[lane];
+        }
+    }
+    for (; i < n; ++i)
+    {
+        mins[0] = data[i] < mins[0] ? data[i] : mins[0];
+        maxs[0] = maxs[0] < data[i] ? data[i] : maxs[0];
+    }
+    min = *std::min_element(std::begin(mins), std::end(mins));
+    max = *std::max_element(std::begin(maxs), std::end(maxs));
+}
+
+// Pulls up to n values into out, looping over next_batch until n values are collected or the sequence ends.
+template <class T, class V>
+auto fill_block(const next_function_t<T>& next_fn, iteration_result_t<T>* batch, V* out, std::size_t n) -> std::size_t
+{
+    std::size_t filled = 0;
+    while (filled < n)
+    {
+        const std::size_t count = next_fn.next_batch(batch, n - filled);
+        if (count == 0)
+        {
+            break;
+        }
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            out[filled + i] = *std::move(batch[i]);
+        }
+        filled += count;
+    }
+    return filled;
+}
+
+// Calls func(data, count) on consecutive blocks of the sequence values: once on the whole remaining data when the
+// source is contiguous, otherwise on blocks of default_batch_size values copied out of batches.
+template <class T, class Func>
+void for_each_block(const next_function_t<T>& next_fn, Func&& func)
+{
+    using value_type = std::decay_t<T>;
+    if (const maybe<span<value_type>> data = next_fn.contiguous())
+    {
+        if (!data->empty())
+        {
+            func(data->begin(), static_cast<std::size_t>(data->size()));
+        }
+        return;
+    }
+
+    std::vector<iteration_result_t<T>> batch(default_batch_size);
+    value_type block[default_batch_size];
+    while (const std::size_t count = fill_block(next_fn, batch.data(), block, default_batch_size))
+    {
+        func(static_cast<const value_type*>(block), count);
+        if (count < default_batch_size)
+        {
+            break;
+        }
+    }
+}
+
+}  // namespace detail
+
+template <class T>
+struct sequence;
+
+template <class T>
+struct is_sequence : std::false_type
+{
+};
+
+template <class T>
+struct is_sequence<sequence<T>> : std::true_type
+{
+};
+
+template <class T>
+struct inspect_mixin
+{
+    template <class Func>
+    struct next_function
+    {
+        Func m_func;
+        next_function_t<T> m_next;
+
+        auto operator()() const -> iteration_result_t<T>
+        {
+            iteration_result_t<T> next = m_next();
+            if (next)
+            {
+                std::invoke(m_func, *next);
+            }
+            return next;
+        }
+
+        auto push(sink_ref<T> sink) const -> bool
+        {
+            return detail::push_to(
+                m_next,
+                [&](T&& item)
+                {
+                    std::invoke(m_func, item);
+                    return sink(std::forward<T>(item));
+                });
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return m_next.size_hint();
+        }
+
+        auto split(std::size_t parts) const -> std::vector<next_function_t<T>>
+        {
+            if constexpr (detail::is_stateless<Func>::value)
+            {
+                return detail::split_each<T>(
+                    m_next, parts, [&](next_function_t<T> part) { return next_function{ m_func, std::move(part) }; });
+            }
+            else
+            {
+                return {};
+            }
+        }
+    };
+
+    template <class Func>
+    auto inspect(Func&& func) const& -> sequence<T>
+    {
+        return sequence<T>{ next_function<std::decay_t<Func>>{
+            std::forward<Func>(func), static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    template <class Func>
+    auto inspect(Func&& func) && -> sequence<T>
+    {
+        return sequence<T>{ next_function<std::decay_t<Func>>{ std::forward<Func>(func),
+                                                               static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+};
+
+template <class T>
+struct inspect_indexed_mixin
+{
+    template <class Func>
+    struct next_function
+    {
+        Func m_func;
+        next_function_t<T> m_next;
+        mutable std::ptrdiff_t m_index = 0;
+
+        auto operator()() const -> iteration_result_t<T>
+        {
+            iteration_result_t<T> next = m_next();
+            if (next)
+            {
+                std::invoke(m_func, m_index++, *next);
+            }
+            return next;
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return m_next.size_hint();
+        }
+    };
+
+    template <class Func>
+    auto inspect_indexed(Func&& func) const& -> sequence<T>
+    {
+        return sequence<T>{ next_function<std::decay_t<Func>>{
+            std::forward<Func>(func), static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    template <class Func>
+    auto inspect_indexed(Func&& func) && -> sequence<T>
+    {
+        return sequence<T>{ next_function<std::decay_t<Func>>{ std::forward<Func>(func),
+                                                               static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+};
+
+template <class T>
+struct transform_mixin
+{
+    template <class Func, class Out>
+    struct next_function
+    {
+        Func m_func;
+        next_function_t<T> m_next;
+
+        mutable std::vector<iteration_result_t<T>> m_buffer = {};
+
+        auto operator()() const -> iteration_result_t<Out>
+        {
+            iteration_result_t<T> next = m_next();
+            if (next)
+            {
+                return std::invoke(m_func, *std::move(next));
+            }
+            return {};
+        }
+
+        auto next_batch(iteration_result_t<Out>* out, std::size_t n) const -> std::size_t
+        {
+            if (m_buffer.size() < n)
+            {
+                m_buffer.resize(n);
+            }
+            const std::size_t count = m_next.next_batch(m_buffer.data(), n);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                out[i] = std::invoke(m_func, *std::move(m_buffer[i]));
+            }
+            return count;
+        }
+
+        auto push(sink_ref<Out> sink) const -> bool
+        {
+            return detail::push_to(m_next, [&](T&& item) { return sink(std::invoke(m_func, std::forward<T>(item))); });
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return m_next.size_hint();
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            return m_next.advance(n);
+        }
+
+        auto split(std::size_t parts) const -> std::vector<next_function_t<Out>>
+        {
+            if constexpr (detail::is_stateless<Func>::value)
+            {
+                return detail::split_each<Out>(
+                    m_next, parts, [&](next_function_t<T> part) { return next_function{ m_func, std::move(part) }; });
+            }
+            else
+            {
+                return {};
+            }
+        }
+    };
+
+    template <class Func, class Res = std::invoke_result_t<Func, T>>
+    auto transform(Func&& func) const& -> sequence<Res>
+    {
+        return sequence<Res>{ next_function<std::decay_t<Func>, Res>{
+            std::forward<Func>(func), static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    template <class Func, class Res = std::invoke_result_t<Func, T>>
+    auto transform(Func&& func) && -> sequence<Res>
+    {
+        return sequence<Res>{ next_function<std::decay_t<Func>, Res>{
+            std::forward<Func>(func), static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+};
+
+template <class T>
+struct transform_indexed_mixin
+{
+    template <class Func, class Out>
+    struct next_function
+    {
+        Func m_func;
+        next_function_t<T> m_next;
+        mutable std::ptrdiff_t m_index = 0;
+
+        auto operator()() const -> iteration_result_t<Out>
+        {
+            iteration_result_t<T> next = m_next();
+            if (next)
+            {
+                return std::invoke(m_func, m_index++, *std::move(next));
+            }
+            return {};
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return m_next.size_hint();
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            const std::size_t count = m_next.advance(n);
+            m_index += static_cast<std::ptrdiff_t>(count);
+            return count;
+        }
+    };
+
+    template <class Func, class Res = std::invoke_result_t<Func, std::ptrdiff_t, T>>
+    auto transform_indexed(Func&& func) const& -> sequence<Res>
+    {
+        return sequence<Res>{ next_function<std::decay_t<Func>, Res>{
+            std::forward<Func>(func), static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    template <class Func, class Res = std::invoke_result_t<Func, std::ptrdiff_t, T>>
+    auto transform_indexed(Func&& func) && -> sequence<Res>
+    {
+        return sequence<Res>{ next_function<std::decay_t<Func>, Res>{
+            std::forward<Func>(func), static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+};
+
+template <class T>
+struct transform_maybe_mixin
+{
+    template <class Func, class Out>
+    struct next_function
+    {
+        Func m_func;
+        next_function_t<T> m_next;
+
+        auto operator()() const -> iteration_result_t<Out>
+        {
+            while (true)
+            {
+                iteration_result_t<T> res = m_next();
+                if (!res)
+                {
+                    break;
+                }
+
+                iteration_result_t<Out> r = std::invoke(m_func, *std::move(res));
+                if (r)
+                {
+                    return r;
+                }
+            }
+            return {};
+        }
+    };
+
+    template <class Func, class Res = maybe_underlying_type_t<std::invoke_result_t<Func, T>>>
+    auto transform_maybe(Func&& func) const& -> sequence<Res>
+    {
+        return sequence<Res>{ next_function<std::decay_t<Func>, Res>{
+            std::forward<Func>(func), static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    template <class Func, class Res = maybe_underlying_type_t<std::invoke_result_t<Func, T>>>
+    auto transform_maybe(Func&& func) && -> sequence<Res>
+    {
+        return sequence<Res>{ next_function<std::decay_t<Func>, Res>{
+            std::forward<Func>(func), static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+};
+
+template <class T>
+struct transform_maybe_indexed_mixin
+{
+    template <class Func, class Out>
+    struct next_function
+    {
+        Func m_func;
+        next_function_t<T> m_next;
+        mutable std::ptrdiff_t m_index;
+
+        auto operator()() const -> iteration_result_t<Out>
+        {
+            while (true)
+            {
+                iteration_result_t<T> res = m_next();
+                if (!res)
+                {
+                    break;
+                }
+
+                iteration_result_t<Out> r = std::invoke(m_func, m_index++, *std::move(res));
+                if (r)
+                {
+                    return r;
+                }
+            }
+            return {};
+        }
+    };
+
+    template <class Func, class Res = maybe_underlying_type_t<std::invoke_result_t<Func, std::ptrdiff_t, T>>>
+    auto transform_maybe_indexed(Func&& func) const& -> sequence<Res>
+    {
+        return sequence<Res>{ next_function<std::decay_t<Func>, Res>{
+            std::forward<Func>(func), static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    template <class Func, class Res = maybe_underlying_type_t<std::invoke_result_t<Func, std::ptrdiff_t, T>>>
+    auto transform_maybe_indexed(Func&& func) && -> sequence<Res>
+    {
+        return sequence<Res>{ next_function<std::decay_t<Func>, Res>{
+            std::forward<Func>(func), static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+};
+
+template <class T>
+struct filter_mixin
+{
+    template <class Pred>
+    struct next_function
+    {
+        Pred m_pred;
+        next_function_t<T> m_next;
+
+        auto operator()() const -> iteration_result_t<T>
+        {
+            while (true)
+            {
+                iteration_result_t<T> res = m_next();
+                if (!res)
+                {
+                    break;
+                }
+
+                if (std::invoke(m_pred, *res))
+                {
+                    return res;
+                }
+            }
+            return {};
+        }
+
+        auto next_batch(iteration_result_t<T>* out, std::size_t n) const -> std::size_t
+        {
+            while (true)
+            {
+                const std::size_t count = m_next.next_batch(out, n);
+                if (count == 0)
+                {
+                    return 0;
+                }
+
+                std::size_t kept = 0;
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    if (std::invoke(m_pred, *out[i]))
+                    {
+                        if (kept != i)
+                        {
+                            out[kept] = std::move(out[i]);
+                        }
+                        ++kept;
+                    }
+                }
+                if (kept > 0)
+                {
+                    return kept;
+                }
+            }
+        }
+
+        auto push(sink_ref<T> sink) const -> bool
+        {
+            return detail::push_to(
+                m_next, [&](T&& item) { return !std::invoke(m_pred, item) || sink(std::forward<T>(item)); });
+        }
+
+        auto split(std::size_t parts) const -> std::vector<next_function_t<T>>
+        {
+            if constexpr (detail::is_stateless<Pred>::value)
+            {
+                return detail::split_each<T>(
+                    m_next, parts, [&](next_function_t<T> part) { return next_function{ m_pred, std::move(part) }; });
+            }
+            else
+            {
+                return {};
+            }
+        }
+    };
+
+    template <class Pred>
+    auto filter(Pred&& pred) const& -> sequence<T>
+    {
+        return sequence<T>{ next_function<std::decay_t<Pred>>{
+            std::forward<Pred>(pred), static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    template <class Pred>
+    auto filter(Pred&& pred) && -> sequence<T>
+    {
+        return sequence<T>{ next_function<std::decay_t<Pred>>{ std::forward<Pred>(pred),
+                                                               static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+};
+
+template <class T>
+struct filter_indexed_mixin
+{
+    template <class Pred>
+    struct next_function
+    {
+        Pred m_pred;
+        next_function_t<T> m_next;
+        mutable std::ptrdiff_t m_index = 0;
+
+        auto operator()() const -> iteration_result_t<T>
+        {
+            while (true)
+            {
+                iteration_result_t<T> res = m_next();
+                if (!res)
+                {
+                    break;
+                }
+
+                if (std::invoke(m_pred, m_index++, *res))
+                {
+                    return res;
+                }
+            }
+            return {};
+        }
+    };
+
+    template <class Pred>
+    auto filter_indexed(Pred&& pred) const& -> sequence<T>
+    {
+        return sequence<T>{ next_function<std::decay_t<Pred>>{
+            std::forward<Pred>(pred), static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    template <class Pred>
+    auto filter_indexed(Pred&& pred) && -> sequence<T>
+    {
+        return sequence<T>{ next_function<std::decay_t<Pred>>{ std::forward<Pred>(pred),
+                                                               static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+};
+
+template <class T>
+struct distinct_mixin
+{
+    template <class KeyFn>
+    using key_t = std::decay_t<std::invoke_result_t<KeyFn, T>>;
+
+    // Remembers the keys seen in Set (flat_hash_set or bloom_filter). It does not split, as every part would need
+    // all the keys seen, so the parallel terminals pull from it under a lock.
+    template <class KeyFn, class Set>
+    struct next_function
+    {
+        KeyFn m_key_fn;
+        mutable Set m_seen;
+        next_function_t<T> m_next;
+
+        auto operator()() const -> iteration_result_t<T>
+        {
+            while (true)
+            {
+                iteration_result_t<T> res = m_next();
+                if (!res || m_seen.insert(std::invoke(m_key_fn, *res)))
+                {
+                    return res;
+                }
+            }
+        }
+
+        auto push(sink_ref<T> sink) const -> bool
+        {
+            return detail::push_to(
+                m_next,
+                [&](T&& item) { return !m_seen.insert(std::invoke(m_key_fn, item)) || sink(std::forward<T>(item)); });
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            const size_hint_t hint = m_next.size_hint();
+            return size_hint_t{ std::min<std::size_t>(hint.lower, 1), hint.upper };
+        }
+    };
+
+    struct self_key
+    {
+        template <class U>
+        auto operator()(const U& item) const -> const U&
+        {
+            return item;
+        }
+    };
+
+    // Yields the elements whose key was not yielded before. All the distinct keys are kept in memory.
+    template <class KeyFn>
+    auto distinct_by(KeyFn key_fn) const& -> sequence<T>
+    {
+        return sequence<T>{ next_function<KeyFn, flat_hash_set<key_t<KeyFn>>>{
+            std::move(key_fn), {}, static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    template <class KeyFn>
+    auto distinct_by(KeyFn key_fn) && -> sequence<T>
+    {
+        return sequence<T>{ next_function<KeyFn, flat_hash_set<key_t<KeyFn>>>{
+            std::move(key_fn), {}, static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+
+    // Approximate variant in the fixed memory of the filter: duplicates are never yielded, but an element whose key
+    // is a false positive of the filter is dropped too.
+    template <class KeyFn, class Hash>
+    auto distinct_by(KeyFn key_fn, bloom_filter<key_t<KeyFn>, Hash> seen) const& -> sequence<T>
+    {
+        return sequence<T>{ next_function<KeyFn, bloom_filter<key_t<KeyFn>, Hash>>{
+            std::move(key_fn), std::move(seen), static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    template <class KeyFn, class Hash>
+    auto distinct_by(KeyFn key_fn, bloom_filter<key_t<KeyFn>, Hash> seen) && -> sequence<T>
+    {
+        return sequence<T>{ next_function<KeyFn, bloom_filter<key_t<KeyFn>, Hash>>{
+            std::move(key_fn), std::move(seen), static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+
+    auto distinct() const& -> sequence<T>
+    {
+        return distinct_by(self_key{});
+    }
+
+    auto distinct() && -> sequence<T>
+    {
+        return std::move(*this).distinct_by(self_key{});
+    }
+
+    template <class Hash>
+    auto distinct(bloom_filter<std::decay_t<T>, Hash> seen) const& -> sequence<T>
+    {
+        return distinct_by(self_key{}, std::move(seen));
+    }
+
+    template <class Hash>
+    auto distinct(bloom_filter<std::decay_t<T>, Hash> seen) && -> sequence<T>
+    {
+        return std::move(*this).distinct_by(self_key{}, std::move(seen));
+    }
+};
+
+template <class T>
+struct drop_while_mixin
+{
+    template <class Pred>
+    struct next_function
+    {
+        Pred m_pred;
+        next_function_t<T> m_next;
+        mutable bool m_init = true;
+
+        auto operator()() const -> iteration_result_t<T>
+        {
+            if (m_init)
+            {
+                while (true)
+                {
+                    iteration_result_t<T> res = m_next();
+                    if (!res)
+                    {
+                        return {};
+                    }
+                    if (!std::invoke(m_pred, *res))
+                    {
+                        m_init = false;
+                        return res;
+                    }
+                }
+            }
+            return m_next();
+        }
+    };
+
+    template <class Pred>
+    auto drop_while(Pred&& pred) const& -> sequence<T>
+    {
+        return sequence<T>{ next_function<std::decay_t<Pred>>{
+            std::forward<Pred>(pred), static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    template <class Pred>
+    auto drop_while(Pred&& pred) && -> sequence<T>
+    {
+        return sequence<T>{ next_function<std::decay_t<Pred>>{ std::forward<Pred>(pred),
+                                                               static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+};
+
+template <class T>
+struct drop_while_indexed_mixin
+{
+    template <class Pred>
+    struct next_function
+    {
+        Pred m_pred;
+        next_function_t<T> m_next;
+        mutable bool m_init = true;
+        mutable std::ptrdiff_t m_index = 0;
+
+        auto operator()() const -> iteration_result_t<T>
+        {
+            if (m_init)
+            {
+                while (true)
+                {
+                    iteration_result_t<T> res = m_next();
+                    if (!res)
+                    {
+                        return {};
+                    }
+                    if (!std::invoke(m_pred, m_index++, *res))
+                    {
+                        m_init = false;
+                        return res;
+                    }
+                }
+            }
+            return m_next();
+        }
+    };
+
+    template <class Pred>
+    auto drop_while_indexed(Pred&& pred) const& -> sequence<T>
+    {
+        return sequence<T>{ next_function<std::decay_t<Pred>>{
+            std::forward<Pred>(pred), static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    template <class Pred>
+    auto drop_while_indexed(Pred&& pred) && -> sequence<T>
+    {
+        return sequence<T>{ next_function<std::decay_t<Pred>>{ std::forward<Pred>(pred),
+                                                               static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+};
+
+template <class T>
+struct take_while_mixin
+{
+    template <class Pred>
+    struct next_function
+    {
+        Pred m_pred;
+        next_function_t<T> m_next;
+
+        auto operator()() const -> iteration_result_t<T>
+        {
+            iteration_result_t<T> res = m_next();
+            if (!(res && std::invoke(m_pred, *res)))
+            {
+                return {};
+            }
+            return res;
+        }
+    };
+
+    template <class Pred>
+    auto take_while(Pred&& pred) const& -> sequence<T>
+    {
+        return sequence<T>{ next_function<std::decay_t<Pred>>{
+            std::forward<Pred>(pred), static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    template <class Pred>
+    auto take_while(Pred&& pred) && -> sequence<T>
+    {
+        return sequence<T>{ next_function<std::decay_t<Pred>>{ std::forward<Pred>(pred),
+                                                               static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+};
+
+template <class T>
+struct take_while_indexed_mixin
+{
+    template <class Pred>
+    struct next_function
+    {
+        Pred m_pred;
+        next_function_t<T> m_next;
+        mutable std::ptrdiff_t m_index = 0;
+
+        auto operator()() const -> iteration_result_t<T>
+        {
+            iteration_result_t<T> res = m_next();
+            if (!(res && std::invoke(m_pred, m_index++, *res)))
+            {
+                return {};
+            }
+            return res;
+        }
+    };
+
+    template <class Pred>
+    auto take_while_indexed(Pred&& pred) const& -> sequence<T>
+    {
+        return sequence<T>{ next_function<std::decay_t<Pred>>{
+            std::forward<Pred>(pred), static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    template <class Pred>
+    auto take_while_indexed(Pred&& pred) && -> sequence<T>
+    {
+        return sequence<T>{ next_function<std::decay_t<Pred>>{ std::forward<Pred>(pred),
+                                                               static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+};
+
+template <class T>
+struct drop_mixin
+{
+    struct next_function
+    {
+        mutable std::ptrdiff_t m_count;
+        next_function_t<T> m_next;
+        mutable bool m_init = false;
+
+        void init() const
+        {
+            if (!m_init)
+            {
+                if (m_count > 0)
+                {
+                    m_next.advance(static_cast<std::size_t>(m_count));
+                }
+                m_count = 0;
+                m_init = true;
+            }
+        }
+
+        auto operator()() const -> iteration_result_t<T>
+        {
+            init();
+            return m_next();
+        }
+
+        auto push(sink_ref<T> sink) const -> bool
+        {
+            init();
+            return m_next.push(sink);
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            init();
+            return m_next.advance(n);
+        }
+
+        auto contiguous() const -> maybe<span<std::decay_t<T>>>
+        {
+            init();
+            return m_next.contiguous();
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            const size_hint_t hint = m_next.size_hint();
+            const auto count = static_cast<std::size_t>(m_init ? 0 : std::max<std::ptrdiff_t>(m_count, 0));
+            const auto remaining = [&](std::size_t n) { return detail::saturating_sub(n, count); };
+            return size_hint_t{ remaining(hint.lower), hint.upper.transform(remaining) };
+        }
+    };
+
+    auto drop(std::ptrdiff_t n) const& -> sequence<T>
+    {
+        return sequence<T>{ next_function{ n, static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    auto drop(std::ptrdiff_t n) && -> sequence<T>
+    {
+        return sequence<T>{ next_function{ n, static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+};
+
+template <class T>
+struct take_mixin
+{
+    struct next_function
+    {
+        mutable std::ptrdiff_t m_count;
+        next_function_t<T> m_next;
+
+        auto operator()() const -> iteration_result_t<T>
+        {
+            if (m_count <= 0)
+            {
+                return {};
+            }
+            --m_count;
+            return m_next();
+        }
+
+        // Stops the upstream as soon as the last element is taken, so that it does not produce one more.
+        auto push(sink_ref<T> sink) const -> bool
+        {
+            if (m_count <= 0)
+            {
+                return true;
+            }
+            bool stopped = false;
+            detail::push_to(
+                m_next,
+                [&](T&& item)
+                {
+                    --m_count;
+                    stopped = !sink(std::forward<T>(item));
+                    return !stopped && m_count > 0;
+                });
+            return !stopped;
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            const auto limit = static_cast<std::size_t>(std::max<std::ptrdiff_t>(m_count, 0));
+            const std::size_t count = m_next.advance(std::min(n, limit));
+            m_count -= static_cast<std::ptrdiff_t>(count);
+            return count;
+        }
+
+        auto contiguous() const -> maybe<span<std::decay_t<T>>>
+        {
+            const std::ptrdiff_t count = std::max<std::ptrdiff_t>(m_count, 0);
+            return m_next.contiguous().transform([&](span<std::decay_t<T>> data) { return data.take(count); });
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            const size_hint_t hint = m_next.size_hint();
+            const auto count = static_cast<std::size_t>(std::max<std::ptrdiff_t>(m_count, 0));
+            return size_hint_t{ std::min(hint.lower, count), detail::min_upper(hint.upper, count) };
+        }
+    };
+
+    // A negative n takes nothing, as drop of a negative n drops nothing.
+    auto take(std::ptrdiff_t n) const& -> sequence<T>
+    {
+        return sequence<T>{ next_function{ n, static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    auto take(std::ptrdiff_t n) && -> sequence<T>
+    {
+        return sequence<T>{ next_function{ n, static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+};
+
+template <class T>
+struct step_mixin
+{
+    struct next_function
+    {
+        mutable std::ptrdiff_t m_count;
+        next_function_t<T> m_next;
+        mutable std::ptrdiff_t m_index = 0;
+
+        // Number of upstream positions in [m_index, m_index + n) which are multiples of m_count, i.e. are yielded.
+        auto selected(std::size_t n) const -> std::size_t
+        {
+            const auto index = static_cast<std::size_t>(m_index);
+            const auto count = static_cast<std::size_t>(m_count);
+            const std::size_t end = detail::saturating_add(index, n);
+            return (end / count + (end % count != 0)) - (index / count + (index % count != 0));
+        }
+
+        // Skips the upstream elements up to the next yielded position.
+        void align() const
+        {
+            if (const std::ptrdiff_t rem = m_index % m_count; rem != 0)
+            {
+                m_index += static_cast<std::ptrdiff_t>(m_next.advance(static_cast<std::size_t>(m_count - rem)));
+            }
+        }
+
+        auto operator()() const -> iteration_result_t<T>
+        {
+            align();
+            iteration_result_t<T> res = m_next();
+            if (res)
+            {
+                ++m_index;
+            }
+            return res;
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            align();
+            const std::size_t skipped = m_next.advance(detail::saturating_mul(n, static_cast<std::size_t>(m_count)));
+            const std::size_t count = selected(skipped);
+            m_index += static_cast<std::ptrdiff_t>(skipped);
+            return count;
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            const size_hint_t hint = m_next.size_hint();
+            const auto selected = [&](std::size_t n) { return this->selected(n); };
+            return size_hint_t{ selected(hint.lower), hint.upper.transform(selected) };
+        }
+    };
+
+    auto step(std::ptrdiff_t n) const& -> sequence<T>
+    {
+        return sequence<T>{ next_function{ n, static_cast<const sequence<T>&>(*this).get_next_function() } };
+    }
+
+    auto step(std::ptrdiff_t n) && -> sequence<T>
+    {
+        return sequence<T>{ next_function{ n, static_cast<sequence<T>&&>(*this).get_next_function() } };
+    }
+};
+
+template <class T, class = void>
+struct numeric_mixin
+{
+};
+
+// Reductions of arithmetic sequences, computed by detail::*_kernel over contiguous blocks: directly over the source
+// memory when it is a contiguous view, otherwise over values copied out in batches.
+template <class T>
+struct numeric_mixin<T, std::enable_if_t<std::is_arithmetic_v<std::decay_t<T>>>>
+{
+    using numeric_type = std::decay_t<T>;
+
+    template <class Acc = numeric_type>
+    auto sum() const& -> Acc
+    {
+        return sum_of<Acc>(static_cast<const sequence<T>&>(*this).get_next_function());
+    }
+
+    template <class Acc = numeric_type>
+    auto sum() && -> Acc
+    {
+        return sum_of<Acc>(static_cast<sequence<T>&&>(*this).get_next_function());
+    }
+
+    auto min() const& -> maybe<numeric_type>
+    {
+        return minmax().transform([](const auto& p) { return p.first; });
+    }
+
+    auto min() && -> maybe<numeric_type>
+    {
+        return std::move(*this).minmax().transform([](const auto& p) { return p.first; });
+    }
+
+    auto max() const& -> maybe<numeric_type>
+    {
+        return minmax().transform([](const auto& p) { return p.second; });
+    }
+
+    auto max() && -> maybe<numeric_type>
+    {
+        return std::move(*this).minmax().transform([](const auto& p) { return p.second; });
+    }
+
+    auto minmax() const& -> maybe<std::pair<numeric_type, numeric_type>>
+    {
+        return minmax_of(static_cast<const sequence<T>&>(*this).get_next_function());
+    }
+
+    auto minmax() && -> maybe<std::pair<numeric_type, numeric_type>>
+    {
+        return minmax_of(static_cast<sequence<T>&&>(*this).get_next_function());
+    }
+
+    // Sum of the products of the corresponding elements; stops at the end of the shorter sequence.
+    template <class U, class Acc = std::common_type_t<numeric_type, std::decay_t<U>>>
+    auto dot(const sequence<U>& other) const& -> Acc
+    {
+        return dot_of<Acc>(static_cast<const sequence<T>&>(*this).get_next_function(), other.get_next_function());
+    }
+
+    template <class U, class Acc = std::common_type_t<numeric_type, std::decay_t<U>>>
+    auto dot(const sequence<U>& other) && -> Acc
+    {
+        return dot_of<Acc>(static_cast<sequence<T>&&>(*this).get_next_function(), other.get_next_function());
+    }
+
+private:
+    template <class Acc>
+    static auto sum_of(next_function_t<T> next_fn) -> Acc
+    {
+        Acc result{};
+        detail::for_each_block(
+            next_fn,
+            [&](const numeric_type* data, std::size_t n) { result += detail::sum_kernel<Acc>(data, n); });
+        return result;
+    }
+
+    static auto minmax_of(next_function_t<T> next_fn) -> maybe<std::pair<numeric_type, numeric_type>>
+    {
+        maybe<std::pair<numeric_type, numeric_type>> result;
+        detail::for_each_block(
+            next_fn,
+            [&](const numeric_type* data, std::size_t n)
+            {
+                if (!result)
+                {
+                    result = std::pair<numeric_type, numeric_type>{ data[0], data[0] };
+                }
+                detail::minmax_kernel(data, n, result->first, result->second);
+            });
+        return result;
+    }
+
+    template <class Acc, class U>
+    static auto dot_of(next_function_t<T> lhs_fn, next_function_t<U> rhs_fn) -> Acc
+    {
+        using other_type = std::decay_t<U>;
+        const maybe<span<numeric_type>> lhs_data = lhs_fn.contiguous();
+        const maybe<span<other_type>> rhs_data = rhs_fn.contiguous();
+        if (lhs_data && rhs_data)
+        {
+            const auto n = static_cast<std::size_t>(std::min(lhs_data->size(), rhs_data->size()));
+            return n > 0 ? detail::dot_kernel<Acc>(lhs_data->begin(), rhs_data->begin(), n) : Acc{};
+        }
+
+        std::vector<iteration_result_t<T>> lhs_batch(default_batch_size);
+        std::vector<iteration_result_t<U>> rhs_batch(default_batch_size);
+        numeric_type lhs_block[default_batch_size];
+        other_type rhs_block[default_batch_size];
+        Acc result{};
+        while (true)
+        {
+            const std::size_t lhs_count = detail::fill_block(lhs_fn, lhs_batch.data(), lhs_block, default_batch_size);
+            const std::size_t count = detail::fill_block(rhs_fn, rhs_batch.data(), rhs_block, lhs_count);
+            result += detail::dot_kernel<Acc>(lhs_block, rhs_block, count);
+            if (count < default_batch_size)
+            {
+                return result;
+            }
+        }
+    }
+};
+
+template <class T>
+struct window_mixin
+{
+    using window_value_type = std::decay_t<T>;
+
+    // Yields windows of m_size elements whose starts are m_step elements apart. With m_partial set, a trailing
+    // window shorter than m_size is yielded too. When the upstream elements lie in contiguous memory, the windows
+    // are views of it and nothing is copied. Otherwise elements are pulled in batches into a buffer which is reused
+    // across iterations; once a window would run past its end, the retained tail is moved to the front, so the
+    // buffer never reallocates and at most one element move per pulled element is paid.
+    struct next_function
+    {
+        std::size_t m_size;
+        std::size_t m_step;
+        bool m_partial;
+        next_function_t<T> m_next;
+        mutable std::vector<window_value_type> m_buffer = {};
+        mutable std::vector<iteration_result_t<T>> m_batch = {};
+        mutable maybe<span<window_value_type>> m_source = {};
+        mutable std::size_t m_begin = 0;
+        mutable bool m_init = false;
+        mutable bool m_exhausted = false;
+
+        auto operator()() const -> iteration_result_t<span<window_value_type>>
+        {
+            const std::size_t capacity = m_size + std::max(m_size, default_batch_size);
+            if (!m_init)
+            {
+                m_init = true;
+                if (init_source())
+                {
+                    return window_of_source();
+                }
+                m_buffer.reserve(capacity);
+                m_batch.resize(std::min(capacity, default_batch_size));
+            }
+            else if (m_source)
+            {
+                m_begin += m_step;
+                return window_of_source();
+            }
+            else if (m_begin + m_step < m_buffer.size())
+            {
+                m_begin += m_step;
+            }
+            else
+            {
+                const std::size_t skip = m_begin + m_step - m_buffer.size();
+                m_buffer.clear();
+                m_begin = 0;
+                if (skip > 0 && (m_exhausted || m_next.advance(skip) < skip))
+                {
+                    m_exhausted = true;
+                    return {};
+                }
+            }
+
+            if (m_begin + m_size > capacity)
+            {
+                m_buffer.erase(m_buffer.begin(), m_buffer.begin() + static_cast<std::ptrdiff_t>(m_begin));
+                m_begin = 0;
+            }
+
+            while (!m_exhausted && m_buffer.size() - m_begin < m_size)
+            {
+                const std::size_t count
+                    = m_next.next_batch(m_batch.data(), std::min(m_batch.size(), capacity - m_buffer.size()));
+                if (count == 0)
+                {
+                    m_exhausted = true;
+                    break;
+                }
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    m_buffer.push_back(*std::move(m_batch[i]));
+                }
+            }
+
+            const std::size_t count = std::min(m_buffer.size() - m_begin, m_size);
+            if (count == m_size || (m_partial && count > 0))
+            {
+                return span<window_value_type>{ m_buffer.data() + m_begin, static_cast<std::ptrdiff_t>(count) };
+            }
+            return {};
+        }
+
+        // The windows of a contiguous source stay valid, so they are pulled ahead; buffered ones only one at a time.
+        auto next_batch(iteration_result_t<span<window_value_type>>* out, std::size_t n) const -> std::size_t
+        {
+            std::size_t count = 0;
+            while (count < n)
+            {
+                iteration_result_t<span<window_value_type>> next = (*this)();
+                if (!next)
+                {
+                    break;
+                }
+                out[count++] = std::move(next);
+                if (!m_source)
+                {
+                    break;
+                }
+            }
+            return count;
+        }
+
+        auto push(sink_ref<span<window_value_type>> sink) const -> bool
+        {
+            if (!m_init)
+            {
+                m_init = true;
+                if (!init_source())
+                {
+                    m_init = false;
+                }
+                else if (iteration_result_t<span<window_value_type>> first = window_of_source())
+                {
+                    if (!sink(*std::move(first)))
+                    {
+                        return false;
+                    }
+                }
+                else
+                {
+                    return true;
+                }
+            }
+            if (m_source)
+            {
+                const std::size_t available = source_size();
+                for (m_begin += m_step; m_begin < available; m_begin += m_step)
+                {
+                    const std::size_t count = std::min(available - m_begin, m_size);
+                    if (count < m_size && !m_partial)
+                    {
+                        break;
+                    }
+                    if (!sink(span<window_value_type>{ m_source->begin() + m_begin, static_cast<std::ptrdiff_t>(count) }))
+                    {
+                        return false;
+                    }
+                }
+                m_begin = std::min(m_begin, available);
+                return true;
+            }
+            while (iteration_result_t<span<window_value_type>> next = (*this)())
+            {
+                if (!sink(*std::move(next)))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Takes the upstream elements as the source of the windows when they lie in contiguous memory. They are
+        // marked as consumed at once; the memory stays valid as long as the upstream stage, which is held here.
+        auto init_source() const -> bool
+        {
+            m_source = m_next.contiguous();
+            if (m_source)
+            {
+                m_next.advance(source_size());
+            }
+            return static_cast<bool>(m_source);
+        }
+
+        auto window_of_source() const -> iteration_result_t<span<window_value_type>>
+        {
+            const std::size_t count = std::min(detail::saturating_sub(source_size(), m_begin), m_size);
+            if (count == m_size || (m_partial && count > 0))
+            {
+                return span<window_value_type>{ m_source->begin() + m_begin, static_cast<std::ptrdiff_t>(count) };
+            }
+            return {};
+        }
+
+        auto buffered() const -> std::size_t
+        {
+            return m_source ? detail::saturating_sub(source_size(), m_begin) : m_buffer.size() - m_begin;
+        }
+
+        auto source_size() const -> std::size_t
+        {
+            return static_cast<std::size_t>(m_source->size());
+        }
+
+        // Number of windows which can be formed out of n more elements.
+        auto windows(std::size_t n) const -> std::size_t
+        {
+            const std::size_t available = detail::saturating_add(buffered(), n);
+            const std::size_t offset = m_init ? m_step : 0;
+            if (available <= offset)
+            {
+                return 0;
+            }
+            const std::size_t rest = available - offset;
+            if (m_partial)
+            {
+                return rest / m_step + (rest % m_step != 0);
+            }
+            return rest >= m_size ? (rest - m_size) / m_step + 1 : 0;
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            const size_hint_t hint = m_next.size_hint();
+            const auto windows = [&](std::size_t n) { return this->windows(n); };
+            return size_hint_t{ windows(hint.lower), hint.upper.transform(windows) };
+        }
+    };
+
+    struct owning_next_function
+    {
+        next_function m_next;
+
+        auto operator()() const -> iteration_result_t<std::vector<window_value_type>>
+        {
+            iteration_result_t<span<window_value_type>> next = m_next();
+            if (!next)
+            {
+                return {};
+            }
+            return std::vector<window_value_type>(next->begin(), next->end());
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return m_next.size_hint();
+        }
+    };
+
+    // Windows are views into the internal buffer, valid until the next element is pulled. The *_owning variants
+    // yield vectors instead.
+    auto window_step(std::ptrdiff_t n, std::ptrdiff_t k) const& -> sequence<span<window_value_type>>
+    {
+        return sequence<span<window_value_type>>{ make_next_function(
+            n, k, false, static_cast<const sequence<T>&>(*this).get_next_function()) };
+    }
+
+    auto window_step(std::ptrdiff_t n, std::ptrdiff_t k) && -> sequence<span<window_value_type>>
+    {
+        return sequence<span<window_value_type>>{ make_next_function(
+            n, k, false, static_cast<sequence<T>&&>(*this).get_next_function()) };
+    }
+
+    auto window(std::ptrdiff_t n) const& -> sequence<span<window_value_type>>
+    {
+        return window_step(n, 1);
+    }
+
+    auto window(std::ptrdiff_t n) && -> sequence<span<window_value_type>>
+    {
+        return std::move(*this).window_step(n, 1);
+    }
+
+    auto chunk(std::ptrdiff_t n) const& -> sequence<span<window_value_type>>
+    {
+        return sequence<span<window_value_type>>{ make_next_function(
+            n, n, true, static_cast<const sequence<T>&>(*this).get_next_function()) };
+    }
+
+    auto chunk(std::ptrdiff_t n) && -> sequence<span<window_value_type>>
+    {
+        return sequence<span<window_value_type>>{ make_next_function(
+            n, n, true, static_cast<sequence<T>&&>(*this).get_next_function()) };
+    }
+
+    auto window_step_owning(std::ptrdiff_t n, std::ptrdiff_t k) const& -> sequence<std::vector<window_value_type>>
+    {
+        return sequence<std::vector<window_value_type>>{ owning_next_function{ make_next_function(
+            n, k, false, static_cast<const sequence<T>&>(*this).get_next_function()) } };
+    }
+
+    auto window_step_owning(std::ptrdiff_t n, std::ptrdiff_t k) && -> sequence<std::vector<window_value_type>>
+    {
+        return sequence<std::vector<window_value_type>>{ owning_next_function{ make_next_function(
+            n, k, false, static_cast<sequence<T>&&>(*this).get_next_function()) } };
+    }
+
+    auto window_owning(std::ptrdiff_t n) const& -> sequence<std::vector<window_value_type>>
+    {
+        return window_step_owning(n, 1);
+    }
+
+    auto window_owning(std::ptrdiff_t n) && -> sequence<std::vector<window_value_type>>
+    {
+        return std::move(*this).window_step_owning(n, 1);
+    }
+
+    auto chunk_owning(std::ptrdiff_t n) const& -> sequence<std::vector<window_value_type>>
+    {
+        return sequence<std::vector<window_value_type>>{ owning_next_function{ make_next_function(
+            n, n, true, static_cast<const sequence<T>&>(*this).get_next_function()) } };
+    }
+
+    auto chunk_owning(std::ptrdiff_t n) && -> sequence<std::vector<window_value_type>>
+    {
+        return sequence<std::vector<window_value_type>>{ owning_next_function{ make_next_function(
+            n, n, true, static_cast<sequence<T>&&>(*this).get_next_function()) } };
+    }
+
+private:
+    static auto make_next_function(std::ptrdiff_t n, std::ptrdiff_t k, bool partial, next_function_t<T> next)
+        -> next_function
+    {
+        if (n <= 0 || k <= 0)
+        {
+            throw std::invalid_argument{ "sequence::window - size and step must be positive" };
+        }
+        return next_function{ static_cast<std::size_t>(n), static_cast<std::size_t>(k), partial, std::move(next) };
+    }
+};
+
+template <class T>
+struct rolling_mixin
+{
+    using rolling_value_type = std::decay_t<T>;
+
+    // Two-stacks sliding window aggregation. The window is split in two: the older part is a stack of the aggregates
+    // from each of its elements to its end, the newer part keeps its elements and their aggregate. The oldest element
+    // is evicted by popping the stack; when it is empty, the newer part is moved onto it, aggregated from the newest
+    // element. The window aggregate is the top of the stack combined with the aggregate of the newer part, so every
+    // element takes part in at most three combinations, and combine need only be associative.
+    template <class Acc, class Combine>
+    struct aggregate_next_function
+    {
+        std::size_t m_size;
+        next_function_t<T> m_next;
+        Acc m_identity;
+        Combine m_combine;
+        mutable std::vector<Acc> m_front = {};
+        mutable std::vector<Acc> m_back = {};
+        mutable Acc m_back_aggregate = m_identity;
+
+        auto count() const -> std::size_t
+        {
+            return m_front.size() + m_back.size();
+        }
+
+        void add(Acc value) const
+        {
+            if (count() == m_size)
+            {
+                if (m_front.empty())
+                {
+                    Acc aggregate = m_identity;
+                    for (auto it = m_back.rbegin(); it != m_back.rend(); ++it)
+                    {
+                        aggregate = std::invoke(m_combine, std::move(*it), std::move(aggregate));
+                        m_front.push_back(aggregate);
+                    }
+                    m_back.clear();
+                    m_back_aggregate = m_identity;
+                }
+                m_front.pop_back();
+            }
+            m_back_aggregate = std::invoke(m_combine, std::move(m_back_aggregate), value);
+            m_back.push_back(std::move(value));
+        }
+
+        auto aggregate() const -> Acc
+        {
+            return m_front.empty() ? m_back_aggregate : std::invoke(m_combine, m_front.back(), m_back_aggregate);
+        }
+
+        auto operator()() const -> iteration_result_t<Acc>
+        {
+            do
+            {
+                iteration_result_t<T> next = m_next();
+                if (!next)
+                {
+                    return {};
+                }
+                add(Acc(*std::move(next)));
+            } while (count() < m_size);
+            return aggregate();
+        }
+
+        auto push(sink_ref<Acc> sink) const -> bool
+        {
+            return detail::push_to(
+                m_next,
+                [&](T&& item)
+                {
+                    add(Acc(std::forward<T>(item)));
+                    return count() < m_size || sink(aggregate());
+                });
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            const auto windows = [&](std::size_t n) { return rolling_windows(count(), m_size, n); };
+            const size_hint_t hint = m_next.size_hint();
+            return size_hint_t{ windows(hint.lower), hint.upper.transform(windows) };
+        }
+    };
+
+    // Monotonic deque: the candidates for the extremum of the current and the later windows, with their positions.
+    // An element removes the candidates it beats from the back, so the front is the extremum, and every element is
+    // added and removed once. There are at most m_size candidates, kept in a ring buffer that stops growing once it
+    // holds that many, so the steady state does not allocate.
+    template <class Compare>
+    struct extremum_next_function
+    {
+        std::size_t m_size;
+        next_function_t<T> m_next;
+        Compare m_compare;
+        mutable std::vector<std::pair<std::size_t, rolling_value_type>> m_candidates = {};
+        mutable std::size_t m_first = 0;
+        mutable std::size_t m_count = 0;
+        mutable std::size_t m_index = 0;
+
+        auto slot(std::size_t offset) const -> std::size_t
+        {
+            const std::size_t result = m_first + offset;
+            return result < m_size ? result : result - m_size;
+        }
+
+        auto front() const -> const rolling_value_type&
+        {
+            return m_candidates[m_first].second;
+        }
+
+        void add(rolling_value_type value) const
+        {
+            if (m_count != 0 && m_candidates[m_first].first + m_size == m_index)
+            {
+                m_first = slot(1);
+                --m_count;
+            }
+            while (m_count != 0 && !std::invoke(m_compare, m_candidates[slot(m_count - 1)].second, value))
+            {
+                --m_count;
+            }
+            // The ring only wraps once it is full, so a slot past the end is always the next one.
+            const std::size_t last = slot(m_count++);
+            if (last == m_candidates.size())
+            {
+                m_candidates.emplace_back(m_index++, std::move(value));
+            }
+            else
+            {
+                m_candidates[last] = { m_index++, std::move(value) };
+            }
+        }
+
+        auto operator()() const -> iteration_result_t<rolling_value_type>
+        {
+            do
+            {
+                iteration_result_t<T> next = m_next();
+                if (!next)
+                {
+                    return {};
+                }
+                add(rolling_value_type(*std::move(next)));
+            } while (m_index < m_size);
+            return front();
+        }
+
+        auto push(sink_ref<rolling_value_type> sink) const -> bool
+        {
+            return detail::push_to(
+                m_next,
+                [&](T&& item)
+                {
+                    add(rolling_value_type(std::forward<T>(item)));
+                    return m_index < m_size || sink(rolling_value_type(front()));
+                });
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            const auto windows = [&](std::size_t n) { return rolling_windows(std::min(m_index, m_size), m_size, n); };
+            const size_hint_t hint = m_next.size_hint();
+            return size_hint_t{ windows(hint.lower), hint.upper.transform(windows) };
+        }
+    };
+
+    // Yields the aggregate of every window of n consecutive elements, in O(1) amortised time per element. Elements
+    // are converted to Acc; combine must be associative and identity its neutral element.
+    template <class Acc, class Combine>
+    auto rolling(std::ptrdiff_t n, Acc identity, Combine combine) const& -> sequence<Acc>
+    {
+        return sequence<Acc>{ aggregate_next_function<Acc, Combine>{
+            window_size(n),
+            static_cast<const sequence<T>&>(*this).get_next_function(),
+            std::move(identity),
+            std::move(combine) } };
+    }
+
+    template <class Acc, class Combine>
+    auto rolling(std::ptrdiff_t n, Acc identity, Combine combine) && -> sequence<Acc>
+    {
+        return sequence<Acc>{ aggregate_next_function<Acc, Combine>{
+            window_size(n),
+            static_cast<sequence<T>&&>(*this).get_next_function(),
+            std::move(identity),
+            std::move(combine) } };
+    }
+
+    auto rolling_sum(std::ptrdiff_t n) const& -> sequence<rolling_value_type>
+    {
+        return rolling(n, rolling_value_type{}, std::plus<>{});
+    }
+
+    auto rolling_sum(std::ptrdiff_t n) && -> sequence<rolling_value_type>
+    {
+        return std::move(*this).rolling(n, rolling_value_type{}, std::plus<>{});
+    }
+
+    auto rolling_min(std::ptrdiff_t n) const& -> sequence<rolling_value_type>
+    {
+        return sequence<rolling_value_type>{ extremum_next_function<std::less<>>{
+            window_size(n), static_cast<const sequence<T>&>(*this).get_next_function(), std::less<>{} } };
+    }
+
+    auto rolling_min(std::ptrdiff_t n) && -> sequence<rolling_value_type>
+    {
+        return sequence<rolling_value_type>{ extremum_next_function<std::less<>>{
+            window_size(n), static_cast<sequence<T>&&>(*this).get_next_function(), std::less<>{} } };
+    }
+
+    auto rolling_max(std::ptrdiff_t n) const& -> sequence<rolling_value_type>
+    {
+        return sequence<rolling_value_type>{ extremum_next_function<std::greater<>>{
+            window_size(n), static_cast<const sequence<T>&>(*this).get_next_function(), std::greater<>{} } };
+    }
+
+    auto rolling_max(std::ptrdiff_t n) && -> sequence<rolling_value_type>
+    {
+        return sequence<rolling_value_type>{ extremum_next_function<std::greater<>>{
+            window_size(n), static_cast<sequence<T>&&>(*this).get_next_function(), std::greater<>{} } };
+    }
+
+private:
+    static auto window_size(std::ptrdiff_t n) -> std::size_t
+    {
+        if (n <= 0)
+        {
+            throw std::invalid_argument{ "sequence::rolling - window size must be positive" };
+        }
+        return static_cast<std::size_t>(n);
+    }
+
+    // Number of windows which can be formed out of n more elements, count of them being buffered already.
+    static auto rolling_windows(std::size_t count, std::size_t size, std::size_t n) -> std::size_t
+    {
+        const std::size_t available = detail::saturating_add(count, n);
+        if (available < size)
+        {
+            return 0;
+        }
+        return count < size ? available - size + 1 : n;
+    }
+};
+
+template <class T, class = void>
+struct split_fields_mixin
+{
+};
+
+// Splitting of text records, e.g. lines, into delimited fields (see detail::field_splitter).
 template <class T>
-using next_function_t = std::function<iteration_result_t<T>()>;
+struct split_fields_mixin<
+    T,
+    std::enable_if_t<std::is_same_v<std::decay_t<T>, std::string> || std::is_same_v<std::decay_t<T>, std::string_view>>>
+{
+    // Same as std::string_view for the supported T; dependent, as sequence is not complete yet.
+    using field_type = std::basic_string_view<typename std::decay_t<T>::value_type>;
+
+    struct next_function
+    {
+        next_function_t<T> m_next;
+        mutable detail::field_splitter m_splitter;
+        mutable iteration_result_t<T> m_record = {};
+
+        auto operator()() const -> iteration_result_t<span<field_type>>
+        {
+            m_record = m_next();
+            if (!m_record)
+            {
+                return {};
+            }
+            if (!m_splitter.split(std::string_view{ *m_record }))
+            {
+                throw std::runtime_error{ "split_fields: unterminated quoted field" };
+            }
+            return m_splitter.fields();
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return m_next.size_hint();
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            return m_next.advance(n);
+        }
+    };
+
+    // Yields the fields of every record, valid until the next one is pulled. A quoted field cannot span records; use
+    // csv_records to read records containing line breaks.
+    auto split_fields(char delim = ',', char quote = '"') const& -> sequence<span<field_type>>
+    {
+        return sequence<span<field_type>>{ next_function{
+            static_cast<const sequence<T>&>(*this).get_next_function(), detail::field_splitter{ delim, quote } } };
+    }
+
+    auto split_fields(char delim = ',', char quote = '"') && -> sequence<span<field_type>>
+    {
+        return sequence<span<field_type>>{ next_function{
+            static_cast<sequence<T>&&>(*this).get_next_function(), detail::field_splitter{ delim, quote } } };
+    }
+
+    // Splits the records and converts their fields with parse_row<Ts...>.
+    template <class... Ts>
+    auto parse_fields(char delim = ',', char quote = '"') const& -> sequence<std::tuple<Ts...>>
+    {
+        return split_fields(delim, quote).transform(parse_row<Ts...>);
+    }
+
+    template <class... Ts>
+    auto parse_fields(char delim = ',', char quote = '"') && -> sequence<std::tuple<Ts...>>
+    {
+        return std::move(*this).split_fields(delim, quote).transform(parse_row<Ts...>);
+    }
+};
 
 template <class T>
-struct sequence;
+struct cache_mixin
+{
+    using cached_type = std::decay_t<T>;
+
+    // Number of elements per chunk of the cache buffer.
+    static constexpr inline std::size_t cache_chunk_size = 1024;
+
+    // Elements produced so far, shared by all the copies of a cached sequence. Chunks are reserved up front and
+    // never grow past cache_chunk_size, so elements keep their addresses once written.
+    struct state
+    {
+        std::mutex m_mutex;
+        next_function_t<T> m_source;
+        std::vector<std::vector<cached_type>> m_chunks = {};
+        std::vector<iteration_result_t<T>> m_batch = {};
+        std::size_t m_size = 0;
+        bool m_exhausted = false;
+
+        explicit state(next_function_t<T> source) : m_source(std::move(source))
+        {
+        }
+
+        // Returns the buffered elements from index to the end of its chunk, pulling from the source if needed.
+        auto fetch(std::size_t index) -> span<cached_type>
+        {
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            while (index >= m_size && !m_exhausted)
+            {
+                pull();
+            }
+            if (index >= m_size)
+            {
+                return {};
+            }
+            const std::vector<cached_type>& chunk = m_chunks[index / cache_chunk_size];
+            return span<cached_type>{ chunk.data() + index % cache_chunk_size, chunk.data() + chunk.size() };
+        }
+
+        auto size_hint(std::size_t index) -> size_hint_t
+        {
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            const std::size_t buffered = detail::saturating_sub(m_size, index);
+            if (m_exhausted)
+            {
+                return size_hint_t::exact(buffered);
+            }
+            const size_hint_t hint = m_source.size_hint();
+            const auto add = [&](std::size_t n) { return detail::saturating_add(n, buffered); };
+            return size_hint_t{ add(hint.lower), hint.upper.transform(add) };
+        }
+
+    private:
+        void pull()
+        {
+            if (m_chunks.empty() || m_chunks.back().size() == cache_chunk_size)
+            {
+                m_chunks.emplace_back().reserve(cache_chunk_size);
+                m_batch.resize(default_batch_size);
+            }
+            std::vector<cached_type>& chunk = m_chunks.back();
+            const std::size_t count
+                = m_source.next_batch(m_batch.data(), std::min(m_batch.size(), cache_chunk_size - chunk.size()));
+            if (count == 0)
+            {
+                m_exhausted = true;
+                m_source = {};
+                m_batch = {};
+                return;
+            }
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                chunk.push_back(*std::move(m_batch[i]));
+            }
+            m_size += count;
+        }
+    };
+
+    // Each copy keeps its own position and replays the buffered elements, taking the lock only once per run of
+    // buffered elements.
+    struct next_function
+    {
+        std::shared_ptr<state> m_state;
+        mutable std::size_t m_index = 0;
+        mutable const cached_type* m_pos = nullptr;
+        mutable const cached_type* m_end = nullptr;
+
+        auto refill() const -> bool
+        {
+            if (m_pos == m_end)
+            {
+                const span<cached_type> data = m_state->fetch(m_index);
+                m_pos = data.begin();
+                m_end = data.end();
+            }
+            return m_pos != m_end;
+        }
+
+        auto operator()() const -> iteration_result_t<const cached_type&>
+        {
+            if (!refill())
+            {
+                return {};
+            }
+            ++m_index;
+            return *m_pos++;
+        }
 
-template <class T>
-struct inspect_mixin
-{
-    template <class Func>
-    struct next_function
-    {
-        Func m_func;
-        next_function_t<T> m_next;
+        auto next_batch(iteration_result_t<const cached_type&>* out, std::size_t n) const -> std::size_t
+        {
+            if (!refill())
+            {
+                return 0;
+            }
+            const std::size_t count = std::min(n, static_cast<std::size_t>(m_end - m_pos));
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                out[i] = m_pos[i];
+            }
+            m_pos += count;
+            m_index += count;
+            return count;
+        }
 
-        auto operator()() const -> iteration_result_t<T>
+        auto push(sink_ref<const cached_type&> sink) const -> bool
         {
-            iteration_result_t<T> next = m_next();
-            if (next)
+            while (refill())
             {
-                std::invoke(m_func, *next);
+                while (m_pos != m_end)
+                {
+                    ++m_index;
+                    if (!sink(*m_pos++))
+                    {
+                        return false;
+                    }
+                }
             }
-            return next;
+            return true;
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return m_state->size_hint(m_index);
         }
     };
 
-    template <class Func>
-    auto inspect(Func&& func) const& -> sequence<T>
+    // Memoises the elements, so that iterating the result more than once, or through concurrent iterators, runs the
+    // upstream stages only once. Elements are pulled on demand and stay buffered as long as any copy is alive.
+    auto cache() const& -> sequence<const cached_type&>
     {
-        return sequence<T>{ next_function<std::decay_t<Func>>{
-            std::forward<Func>(func), static_cast<const sequence<T>&>(*this).get_next_function() } };
+        static_assert(!is_transient<cached_type>::value, "transient elements cannot be cached");
+        return sequence<const cached_type&>{ next_function{ std::make_shared<state>(
+            static_cast<const sequence<T>&>(*this).get_next_function()) } };
     }
 
-    template <class Func>
-    auto inspect(Func&& func) && -> sequence<T>
+    auto cache() && -> sequence<const cached_type&>
     {
-        return sequence<T>{ next_function<std::decay_t<Func>>{ std::forward<Func>(func),
-                                                               static_cast<sequence<T>&&>(*this).get_next_function() } };
+        static_assert(!is_transient<cached_type>::value, "transient elements cannot be cached");
+        return sequence<const cached_type&>{ next_function{ std::make_shared<state>(
+            static_cast<sequence<T>&&>(*this).get_next_function()) } };
     }
 };
 
 template <class T>
-struct inspect_indexed_mixin
+struct tee_mixin
 {
-    template <class Func>
-    struct next_function
+    using tee_type = std::decay_t<T>;
+
+    // Number of elements per chunk of the tee buffer.
+    static constexpr inline std::size_t tee_chunk_size = 1024;
+
+    // Default bound on the number of elements buffered by a tee.
+    static constexpr inline std::size_t default_tee_capacity = std::size_t{ 1 } << 16;
+
+    // Elements pulled from the source and not yet consumed by every output, in chunks; a chunk is released as soon as
+    // all the outputs have moved past it. Chunks never grow past tee_chunk_size, so elements keep their addresses.
+    struct state
     {
-        Func m_func;
-        next_function_t<T> m_next;
-        mutable std::ptrdiff_t m_index = 0;
+        static constexpr std::size_t released = std::numeric_limits<std::size_t>::max();
+
+        std::mutex m_mutex;
+        next_function_t<T> m_source;
+        std::size_t m_capacity;
+        std::deque<std::vector<tee_type>> m_chunks = {};
+        std::vector<iteration_result_t<T>> m_batch = {};
+        // Index of the first element of the first chunk, and number of elements pulled so far.
+        std::size_t m_first = 0;
+        std::size_t m_size = 0;
+        bool m_exhausted = false;
+        // Index of the next element of every output, updated by the outputs without locking; slots of destroyed
+        // outputs are set to released and reused.
+        std::deque<std::atomic<std::size_t>> m_positions = {};
+
+        state(next_function_t<T> source, std::size_t capacity) : m_source(std::move(source)), m_capacity(capacity)
+        {
+        }
 
-        auto operator()() const -> iteration_result_t<T>
+        auto join(std::size_t index) -> std::atomic<std::size_t>*
         {
-            iteration_result_t<T> next = m_next();
-            if (next)
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            for (std::atomic<std::size_t>& position : m_positions)
             {
-                std::invoke(m_func, m_index++, *next);
+                if (position.load(std::memory_order_relaxed) == released)
+                {
+                    position.store(index, std::memory_order_relaxed);
+                    return &position;
+                }
             }
-            return next;
+            return &m_positions.emplace_back(index);
         }
-    };
 
-    template <class Func>
-    auto inspect_indexed(Func&& func) const& -> sequence<T>
-    {
-        return sequence<T>{ next_function<std::decay_t<Func>>{
-            std::forward<Func>(func), static_cast<const sequence<T>&>(*this).get_next_function() } };
-    }
+        void leave(std::atomic<std::size_t>* position)
+        {
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            position->store(released, std::memory_order_relaxed);
+            release();
+        }
 
-    template <class Func>
-    auto inspect_indexed(Func&& func) && -> sequence<T>
-    {
-        return sequence<T>{ next_function<std::decay_t<Func>>{ std::forward<Func>(func),
-                                                               static_cast<sequence<T>&&>(*this).get_next_function() } };
-    }
-};
+        // Returns the buffered elements from index to the end of its chunk, pulling from the source if needed.
+        auto fetch(std::size_t index) -> span<tee_type>
+        {
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            release();
+            while (index >= m_size && !m_exhausted)
+            {
+                pull();
+            }
+            if (index >= m_size)
+            {
+                return {};
+            }
+            const std::vector<tee_type>& chunk = m_chunks[(index - m_first) / tee_chunk_size];
+            return span<tee_type>{ chunk.data() + index % tee_chunk_size, chunk.data() + chunk.size() };
+        }
 
-template <class T>
-struct transform_mixin
-{
-    template <class Func, class Out>
-    struct next_function
-    {
-        Func m_func;
-        next_function_t<T> m_next;
+        auto size_hint(std::size_t index) -> size_hint_t
+        {
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            const std::size_t buffered = detail::saturating_sub(m_size, index);
+            if (m_exhausted)
+            {
+                return size_hint_t::exact(buffered);
+            }
+            const size_hint_t hint = m_source.size_hint();
+            const auto add = [&](std::size_t n) { return detail::saturating_add(n, buffered); };
+            return size_hint_t{ add(hint.lower), hint.upper.transform(add) };
+        }
 
-        auto operator()() const -> iteration_result_t<Out>
+    private:
+        auto slowest() const -> std::size_t
         {
-            iteration_result_t<T> next = m_next();
-            if (next)
+            std::size_t result = m_size;
+            for (const std::atomic<std::size_t>& position : m_positions)
             {
-                return std::invoke(m_func, *std::move(next));
+                result = std::min(result, position.load(std::memory_order_acquire));
             }
-            return {};
+            return result;
         }
-    };
 
-    template <class Func, class Res = std::invoke_result_t<Func, T>>
-    auto transform(Func&& func) const& -> sequence<Res>
-    {
-        return sequence<Res>{ next_function<std::decay_t<Func>, Res>{
-            std::forward<Func>(func), static_cast<const sequence<T>&>(*this).get_next_function() } };
-    }
+        void release()
+        {
+            const std::size_t end = slowest();
+            while (!m_chunks.empty() && m_chunks.front().size() == tee_chunk_size && m_first + tee_chunk_size <= end)
+            {
+                m_chunks.pop_front();
+                m_first += tee_chunk_size;
+            }
+        }
 
-    template <class Func, class Res = std::invoke_result_t<Func, T>>
-    auto transform(Func&& func) && -> sequence<Res>
-    {
-        return sequence<Res>{ next_function<std::decay_t<Func>, Res>{
-            std::forward<Func>(func), static_cast<sequence<T>&&>(*this).get_next_function() } };
-    }
-};
+        void pull()
+        {
+            const std::size_t room = m_capacity - std::min(m_capacity, m_size - slowest());
+            if (room == 0)
+            {
+                throw std::length_error{ "tee: an output is more than capacity elements ahead of another" };
+            }
+            if (m_chunks.empty() || m_chunks.back().size() == tee_chunk_size)
+            {
+                m_chunks.emplace_back().reserve(tee_chunk_size);
+                m_batch.resize(default_batch_size);
+            }
+            std::vector<tee_type>& chunk = m_chunks.back();
+            const std::size_t count = m_source.next_batch(
+                m_batch.data(), std::min({ m_batch.size(), tee_chunk_size - chunk.size(), room }));
+            if (count == 0)
+            {
+                m_exhausted = true;
+                m_source = {};
+                m_batch = {};
+                return;
+            }
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                chunk.push_back(*std::move(m_batch[i]));
+            }
+            m_size += count;
+        }
+    };
 
-template <class T>
-struct transform_indexed_mixin
-{
-    template <class Func, class Out>
+    // An output of the tee. It publishes its position after copying each element, which lets the other outputs
+    // release the chunks behind it. Copies are outputs of their own, starting at the same position, and leave the
+    // original untouched; a moved-from output no longer holds the buffer.
     struct next_function
     {
-        Func m_func;
-        next_function_t<T> m_next;
-        mutable std::ptrdiff_t m_index = 0;
+        std::shared_ptr<state> m_state;
+        std::atomic<std::size_t>* m_position;
+        mutable std::size_t m_index;
+        mutable const tee_type* m_pos = nullptr;
+        mutable const tee_type* m_end = nullptr;
+
+        next_function(std::shared_ptr<state> s, std::size_t index)
+            : m_state(std::move(s))
+            , m_position(m_state->join(index))
+            , m_index(index)
+        {
+        }
 
-        auto operator()() const -> iteration_result_t<Out>
+        next_function(const next_function& other)
+            : m_state(other.m_state)
+            , m_position(m_state->join(other.m_index))
+            , m_index(other.m_index)
         {
-            iteration_result_t<T> next = m_next();
-            if (next)
+        }
+
+        next_function(next_function&& other) noexcept
+            : m_state(std::move(other.m_state))
+            , m_position(std::exchange(other.m_position, nullptr))
+            , m_index(other.m_index)
+            , m_pos(other.m_pos)
+            , m_end(other.m_end)
+        {
+        }
+
+        next_function& operator=(const next_function&) = delete;
+        next_function& operator=(next_function&&) = delete;
+
+        ~next_function()
+        {
+            if (m_state && m_position)
             {
-                return std::invoke(m_func, m_index++, *std::move(next));
+                m_state->leave(m_position);
             }
-            return {};
         }
-    };
-
-    template <class Func, class Res = std::invoke_result_t<Func, std::ptrdiff_t, T>>
-    auto transform_indexed(Func&& func) const& -> sequence<Res>
-    {
-        return sequence<Res>{ next_function<std::decay_t<Func>, Res>{
-            std::forward<Func>(func), static_cast<const sequence<T>&>(*this).get_next_function() } };
-    }
 
-    template <class Func, class Res = std::invoke_result_t<Func, std::ptrdiff_t, T>>
-    auto transform_indexed(Func&& func) && -> sequence<Res>
-    {
-        return sequence<Res>{ next_function<std::decay_t<Func>, Res>{
-            std::forward<Func>(func), static_cast<sequence<T>&&>(*this).get_next_function() } };
-    }
-};
+        auto refill() const -> bool
+        {
+            if (m_pos == m_end)
+            {
+                const span<tee_type> data = m_state->fetch(m_index);
+                m_pos = data.begin();
+                m_end = data.end();
+            }
+            return m_pos != m_end;
+        }
 
-template <class T>
-struct transform_maybe_mixin
-{
-    template <class Func, class Out>
-    struct next_function
-    {
-        Func m_func;
-        next_function_t<T> m_next;
+        void advance_position() const
+        {
+            ++m_pos;
+            m_position->store(++m_index, std::memory_order_release);
+        }
 
-        auto operator()() const -> iteration_result_t<Out>
+        auto operator()() const -> iteration_result_t<tee_type>
         {
-            while (true)
+            if (!refill())
             {
-                iteration_result_t<T> res = m_next();
-                if (!res)
-                {
-                    break;
-                }
+                return {};
+            }
+            iteration_result_t<tee_type> result = *m_pos;
+            advance_position();
+            return result;
+        }
 
-                iteration_result_t<Out> r = std::invoke(m_func, *std::move(res));
-                if (r)
+        auto push(sink_ref<tee_type> sink) const -> bool
+        {
+            while (refill())
+            {
+                while (m_pos != m_end)
                 {
-                    return r;
+                    tee_type item = *m_pos;
+                    advance_position();
+                    if (!sink(std::move(item)))
+                    {
+                        return false;
+                    }
                 }
             }
-            return {};
+            return true;
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return m_state->size_hint(m_index);
         }
     };
 
-    template <class Func, class Res = maybe_underlying_type_t<std::invoke_result_t<Func, T>>>
-    auto transform_maybe(Func&& func) const& -> sequence<Res>
+    // Splits the sequence into n outputs yielding the same elements, while the upstream stages run only once. The
+    // elements consumed by some outputs but not by all are buffered; pulling more than capacity elements ahead of the
+    // slowest output throws std::length_error. Every output holds the buffer from its position until it is destroyed
+    // or moved from, so consume the outputs one after the other through the && terminals, e.g.
+    // std::move(outputs[0]).count(); the const& ones consume a copy and leave the original in place. Running several
+    // terminals one after the other over more than capacity elements needs the whole sequence buffered: hand the
+    // elements to all of them in a single pass with fork_to instead. Outputs may be consumed from different threads.
+    auto tee(std::size_t n, std::size_t capacity = default_tee_capacity) const& -> std::vector<sequence<tee_type>>
     {
-        return sequence<Res>{ next_function<std::decay_t<Func>, Res>{
-            std::forward<Func>(func), static_cast<const sequence<T>&>(*this).get_next_function() } };
+        return make_tee(static_cast<const sequence<T>&>(*this).get_next_function(), n, capacity);
     }
 
-    template <class Func, class Res = maybe_underlying_type_t<std::invoke_result_t<Func, T>>>
-    auto transform_maybe(Func&& func) && -> sequence<Res>
+    auto tee(std::size_t n, std::size_t capacity = default_tee_capacity) && -> std::vector<sequence<tee_type>>
     {
-        return sequence<Res>{ next_function<std::decay_t<Func>, Res>{
-            std::forward<Func>(func), static_cast<sequence<T>&&>(*this).get_next_function() } };
+        return make_tee(static_cast<sequence<T>&&>(*this).get_next_function(), n, capacity);
+    }
+
+private:
+    static auto make_tee(next_function_t<T> source, std::size_t n, std::size_t capacity)
+        -> std::vector<sequence<tee_type>>
+    {
+        static_assert(!is_transient<tee_type>::value, "transient elements cannot be buffered");
+        const auto s = std::make_shared<state>(std::move(source), capacity);
+        std::vector<sequence<tee_type>> result;
+        result.reserve(n);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            result.push_back(sequence<tee_type>{ next_function{ s, 0 } });
+        }
+        return result;
     }
 };
 
 template <class T>
-struct transform_maybe_indexed_mixin
+struct top_k_mixin
 {
-    template <class Func, class Out>
-    struct next_function
+    using selected_type = std::decay_t<T>;
+
+    // The k greatest elements according to comp, in unspecified order. Uses O(k) memory.
+    template <class Compare = std::less<>>
+    auto top_k(std::ptrdiff_t k, Compare comp = {}) const& -> std::vector<selected_type>
     {
-        Func m_func;
-        next_function_t<T> m_next;
-        mutable std::ptrdiff_t m_index;
+        return select(static_cast<const sequence<T>&>(*this).get_next_function(), k, reversed(std::move(comp)));
+    }
 
-        auto operator()() const -> iteration_result_t<Out>
-        {
-            while (true)
-            {
-                iteration_result_t<T> res = m_next();
-                if (!res)
-                {
-                    break;
-                }
+    template <class Compare = std::less<>>
+    auto top_k(std::ptrdiff_t k, Compare comp = {}) && -> std::vector<selected_type>
+    {
+        return select(static_cast<sequence<T>&&>(*this).get_next_function(), k, reversed(std::move(comp)));
+    }
 
-                iteration_result_t<Out> r = std::invoke(m_func, m_index++, *std::move(res));
-                if (r)
-                {
-                    return r;
-                }
-            }
-            return {};
-        }
-    };
+    // The k least elements according to comp, in unspecified order. Uses O(k) memory.
+    template <class Compare = std::less<>>
+    auto bottom_k(std::ptrdiff_t k, Compare comp = {}) const& -> std::vector<selected_type>
+    {
+        return select(static_cast<const sequence<T>&>(*this).get_next_function(), k, std::move(comp));
+    }
 
-    template <class Func, class Res = maybe_underlying_type_t<std::invoke_result_t<Func, std::ptrdiff_t, T>>>
-    auto transform_maybe_indexed(Func&& func) const& -> sequence<Res>
+    template <class Compare = std::less<>>
+    auto bottom_k(std::ptrdiff_t k, Compare comp = {}) && -> std::vector<selected_type>
     {
-        return sequence<Res>{ next_function<std::decay_t<Func>, Res>{
-            std::forward<Func>(func), static_cast<const sequence<T>&>(*this).get_next_function() } };
+        return select(static_cast<sequence<T>&&>(*this).get_next_function(), k, std::move(comp));
+    }
+
+    // The first k elements of the sequence sorted according to comp, i.e. bottom_k in order.
+    template <class Compare = std::less<>>
+    auto sorted_take(std::ptrdiff_t k, Compare comp = {}) const& -> std::vector<selected_type>
+    {
+        std::vector<selected_type> result = bottom_k(k, comp);
+        std::sort_heap(result.begin(), result.end(), comp);
+        return result;
+    }
+
+    template <class Compare = std::less<>>
+    auto sorted_take(std::ptrdiff_t k, Compare comp = {}) && -> std::vector<selected_type>
+    {
+        std::vector<selected_type> result = std::move(*this).bottom_k(k, comp);
+        std::sort_heap(result.begin(), result.end(), comp);
+        return result;
+    }
+
+private:
+    template <class Compare>
+    static auto reversed(Compare comp)
+    {
+        return [comp = std::move(comp)](const auto& lhs, const auto& rhs) { return std::invoke(comp, rhs, lhs); };
+    }
+
+    // Keeps the k least elements in a heap whose front is the greatest of them; an incoming element only enters the
+    // heap if it is less than the front. The result is a valid heap with respect to comp.
+    template <class Compare>
+    static auto select(next_function_t<T> next_fn, std::ptrdiff_t k, Compare comp) -> std::vector<selected_type>
+    {
+        std::vector<selected_type> heap;
+        if (k <= 0)
+        {
+            return heap;
+        }
+        const auto capacity = static_cast<std::size_t>(k);
+        const size_hint_t hint = next_fn.size_hint();
+        heap.reserve(hint.upper ? std::min(capacity, *hint.upper) : capacity);
+        detail::for_each_pushed(
+            next_fn,
+            [&](auto&& item)
+            {
+                if (heap.size() < capacity)
+                {
+                    heap.push_back(std::forward<decltype(item)>(item));
+                    std::push_heap(heap.begin(), heap.end(), comp);
+                }
+                else if (std::invoke(comp, item, heap.front()))
+                {
+                    std::pop_heap(heap.begin(), heap.end(), comp);
+                    heap.back() = std::forward<decltype(item)>(item);
+                    std::push_heap(heap.begin(), heap.end(), comp);
+                }
+            });
+        return heap;
     }
+};
 
-    template <class Func, class Res = maybe_underlying_type_t<std::invoke_result_t<Func, std::ptrdiff_t, T>>>
-    auto transform_maybe_indexed(Func&& func) && -> sequence<Res>
+namespace detail
+{
+
+// Uniformly distributed in (0, 1).
+inline auto open_unit(std::mt19937_64& rng) -> double
+{
+    std::uniform_real_distribution<double> dist{ 0.0, 1.0 };
+    double u = dist(rng);
+    while (u == 0.0)
     {
-        return sequence<Res>{ next_function<std::decay_t<Func>, Res>{
-            std::forward<Func>(func), static_cast<sequence<T>&&>(*this).get_next_function() } };
+        u = dist(rng);
     }
-};
+    return u;
+}
+
+// Number of elements to skip given by a non-negative, possibly infinite, real number.
+inline auto skip_count(double x) -> std::size_t
+{
+    return x < static_cast<double>(std::numeric_limits<std::size_t>::max())
+               ? static_cast<std::size_t>(x)
+               : std::numeric_limits<std::size_t>::max();
+}
+
+}  // namespace detail
 
 template <class T>
-struct filter_mixin
+struct sample_mixin
 {
-    template <class Pred>
-    struct next_function
+    using sampled_type = std::decay_t<T>;
+
+    // The gaps between selected elements are geometrically distributed, so instead of drawing a random number per
+    // element, a gap is drawn per selected element and skipped with advance - in constant time for sources which
+    // support it.
+    struct bernoulli_next_function
     {
-        Pred m_pred;
         next_function_t<T> m_next;
+        double m_log_rejection;
+        mutable std::mt19937_64 m_rng;
 
         auto operator()() const -> iteration_result_t<T>
         {
-            while (true)
+            if (m_log_rejection == 0.0)
             {
-                iteration_result_t<T> res = m_next();
-                if (!res)
-                {
-                    break;
-                }
-
-                if (std::invoke(m_pred, *res))
-                {
-                    return res;
-                }
+                return {};
             }
-            return {};
+            const std::size_t gap = detail::skip_count(std::log(detail::open_unit(m_rng)) / m_log_rejection);
+            if (gap > 0 && m_next.advance(gap) < gap)
+            {
+                return {};
+            }
+            return m_next();
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return size_hint_t{ 0, m_next.size_hint().upper };
         }
     };
 
-    template <class Pred>
-    auto filter(Pred&& pred) const& -> sequence<T>
+    // Selects every element independently with probability p.
+    auto sample_bernoulli(double p, std::uint64_t seed) const& -> sequence<T>
     {
-        return sequence<T>{ next_function<std::decay_t<Pred>>{
-            std::forward<Pred>(pred), static_cast<const sequence<T>&>(*this).get_next_function() } };
+        return sequence<T>{ make_bernoulli(static_cast<const sequence<T>&>(*this).get_next_function(), p, seed) };
     }
 
-    template <class Pred>
-    auto filter(Pred&& pred) && -> sequence<T>
+    auto sample_bernoulli(double p, std::uint64_t seed) && -> sequence<T>
     {
-        return sequence<T>{ next_function<std::decay_t<Pred>>{ std::forward<Pred>(pred),
-                                                               static_cast<sequence<T>&&>(*this).get_next_function() } };
+        return sequence<T>{ make_bernoulli(static_cast<sequence<T>&&>(*this).get_next_function(), p, seed) };
     }
-};
 
-template <class T>
-struct filter_indexed_mixin
-{
-    template <class Pred>
-    struct next_function
+    // Uniform random sample of k elements, or all of them if there are fewer, in unspecified order. Uses O(k)
+    // memory and skips the elements which do not enter the sample with advance.
+    auto reservoir(std::ptrdiff_t k, std::uint64_t seed) const& -> std::vector<sampled_type>
     {
-        Pred m_pred;
-        next_function_t<T> m_next;
-        mutable std::ptrdiff_t m_index = 0;
+        return sample_uniform(static_cast<const sequence<T>&>(*this).get_next_function(), k, seed);
+    }
 
-        auto operator()() const -> iteration_result_t<T>
-        {
-            while (true)
-            {
-                iteration_result_t<T> res = m_next();
-                if (!res)
-                {
-                    break;
-                }
+    auto reservoir(std::ptrdiff_t k, std::uint64_t seed) && -> std::vector<sampled_type>
+    {
+        return sample_uniform(static_cast<sequence<T>&&>(*this).get_next_function(), k, seed);
+    }
 
-                if (std::invoke(m_pred, m_index++, *res))
-                {
-                    return res;
-                }
-            }
-            return {};
-        }
-    };
+    // Random sample of k elements where the probability of an element to be selected is proportional to
+    // weight_fn(element). Elements of non-positive weight are never selected.
+    template <class WeightFn>
+    auto weighted_reservoir(std::ptrdiff_t k, WeightFn weight_fn, std::uint64_t seed) const& -> std::vector<sampled_type>
+    {
+        return sample_weighted(static_cast<const sequence<T>&>(*this).get_next_function(), k, weight_fn, seed);
+    }
 
-    template <class Pred>
-    auto filter_indexed(Pred&& pred) const& -> sequence<T>
+    template <class WeightFn>
+    auto weighted_reservoir(std::ptrdiff_t k, WeightFn weight_fn, std::uint64_t seed) && -> std::vector<sampled_type>
     {
-        return sequence<T>{ next_function<std::decay_t<Pred>>{
-            std::forward<Pred>(pred), static_cast<const sequence<T>&>(*this).get_next_function() } };
+        return sample_weighted(static_cast<sequence<T>&&>(*this).get_next_function(), k, weight_fn, seed);
     }
 
-    template <class Pred>
-    auto filter_indexed(Pred&& pred) && -> sequence<T>
+private:
+    static auto make_bernoulli(next_function_t<T> next_fn, double p, std::uint64_t seed) -> bernoulli_next_function
     {
-        return sequence<T>{ next_function<std::decay_t<Pred>>{ std::forward<Pred>(pred),
-                                                               static_cast<sequence<T>&&>(*this).get_next_function() } };
+        if (!(p >= 0.0 && p <= 1.0))
+        {
+            throw std::invalid_argument{ "sample_bernoulli: p must be in [0, 1]" };
+        }
+        return bernoulli_next_function{ std::move(next_fn), std::log1p(-p), std::mt19937_64{ seed } };
     }
-};
 
-template <class T>
-struct drop_while_mixin
-{
-    template <class Pred>
-    struct next_function
+    // Algorithm L (Li, 1994): the number of elements to skip before the next replacement is drawn directly, so the
+    // cost is O(k (1 + log(n / k))) random draws.
+    static auto sample_uniform(next_function_t<T> next_fn, std::ptrdiff_t k, std::uint64_t seed)
+        -> std::vector<sampled_type>
     {
-        Pred m_pred;
-        next_function_t<T> m_next;
-        mutable bool m_init = true;
+        std::vector<sampled_type> sample;
+        if (k <= 0)
+        {
+            return sample;
+        }
+        const auto capacity = static_cast<std::size_t>(k);
+        const size_hint_t hint = next_fn.size_hint();
+        sample.reserve(hint.upper ? std::min(capacity, *hint.upper) : capacity);
+        while (sample.size() < capacity)
+        {
+            iteration_result_t<T> next = next_fn();
+            if (!next)
+            {
+                return sample;
+            }
+            sample.push_back(*std::move(next));
+        }
 
-        auto operator()() const -> iteration_result_t<T>
+        std::mt19937_64 rng{ seed };
+        std::uniform_int_distribution<std::size_t> slot{ 0, capacity - 1 };
+        double w = std::exp(std::log(detail::open_unit(rng)) / static_cast<double>(k));
+        while (true)
         {
-            if (m_init)
+            const std::size_t gap = detail::skip_count(std::log(detail::open_unit(rng)) / std::log1p(-w));
+            if (gap > 0 && next_fn.advance(gap) < gap)
             {
-                while (true)
+                break;
+            }
+            iteration_result_t<T> next = next_fn();
+            if (!next)
+            {
+                break;
+            }
+            sample[slot(rng)] = *std::move(next);
+            w *= std::exp(std::log(detail::open_unit(rng)) / static_cast<double>(k));
+        }
+        return sample;
+    }
+
+    // Algorithm A-ExpJ (Efraimidis and Spirakis, 2006): every element gets the key u^(1 / weight), and the sample
+    // holds the elements of the k greatest keys. Instead of a key per element, the total weight to skip before the
+    // next replacement is drawn. Keys are kept as logarithms, which do not underflow for large weights.
+    template <class WeightFn>
+    static auto sample_weighted(next_function_t<T> next_fn, std::ptrdiff_t k, WeightFn& weight_fn, std::uint64_t seed)
+        -> std::vector<sampled_type>
+    {
+        using entry = std::pair<double, sampled_type>;
+        std::vector<entry> heap;
+        if (k <= 0)
+        {
+            return {};
+        }
+        const auto capacity = static_cast<std::size_t>(k);
+        const auto greater_key = [](const entry& lhs, const entry& rhs) { return lhs.first > rhs.first; };
+        std::mt19937_64 rng{ seed };
+        double weight_to_skip = 0.0;
+        detail::for_each_pushed(
+            next_fn,
+            [&](auto&& item)
+            {
+                const auto weight = static_cast<double>(std::invoke(weight_fn, item));
+                if (!(weight > 0.0))
                 {
-                    iteration_result_t<T> res = m_next();
-                    if (!res)
-                    {
-                        return {};
-                    }
-                    if (!std::invoke(m_pred, *res))
+                    return;
+                }
+                if (heap.size() < capacity)
+                {
+                    heap.emplace_back(std::log(detail::open_unit(rng)) / weight, std::forward<decltype(item)>(item));
+                    std::push_heap(heap.begin(), heap.end(), greater_key);
+                    if (heap.size() == capacity)
                     {
-                        m_init = false;
-                        return res;
+                        weight_to_skip = std::log(detail::open_unit(rng)) / heap.front().first;
                     }
+                    return;
                 }
-            }
-            return m_next();
+                weight_to_skip -= weight;
+                if (weight_to_skip > 0.0)
+                {
+                    return;
+                }
+                // The new key is drawn uniformly from the keys which exceed the least one.
+                const double threshold = std::exp(weight * heap.front().first);
+                const double u = threshold + (1.0 - threshold) * detail::open_unit(rng);
+                std::pop_heap(heap.begin(), heap.end(), greater_key);
+                heap.back() = entry{ std::log(u) / weight, std::forward<decltype(item)>(item) };
+                std::push_heap(heap.begin(), heap.end(), greater_key);
+                weight_to_skip = std::log(detail::open_unit(rng)) / heap.front().first;
+            });
+
+        std::vector<sampled_type> sample;
+        sample.reserve(heap.size());
+        for (entry& e : heap)
+        {
+            sample.push_back(std::move(e.second));
         }
-    };
+        return sample;
+    }
+};
 
-    template <class Pred>
-    auto drop_while(Pred&& pred) const& -> sequence<T>
+// Upper bound on the number of groups a hash aggregation pre-sizes its table for. The number of groups is bounded by
+// the length of the sequence, but is usually much smaller.
+static constexpr inline std::size_t aggregate_presize_limit = 1 << 10;
+
+template <class T>
+struct aggregate_mixin
+{
+    template <class KeyFn>
+    using key_t = std::decay_t<std::invoke_result_t<KeyFn, T>>;
+
+    // Folds the elements of every group into init with acc = combine(acc, item), grouping by key_fn(item).
+    // Groups are kept in the order of their first element.
+    template <class KeyFn, class Acc, class Combine>
+    auto aggregate_by(KeyFn key_fn, Acc init, Combine combine) const& -> flat_hash_map<key_t<KeyFn>, Acc>
     {
-        return sequence<T>{ next_function<std::decay_t<Pred>>{
-            std::forward<Pred>(pred), static_cast<const sequence<T>&>(*this).get_next_function() } };
+        return aggregate_with(static_cast<const sequence<T>&>(*this).get_next_function(), key_fn, init, combine);
     }
 
-    template <class Pred>
-    auto drop_while(Pred&& pred) && -> sequence<T>
+    template <class KeyFn, class Acc, class Combine>
+    auto aggregate_by(KeyFn key_fn, Acc init, Combine combine) && -> flat_hash_map<key_t<KeyFn>, Acc>
     {
-        return sequence<T>{ next_function<std::decay_t<Pred>>{ std::forward<Pred>(pred),
-                                                               static_cast<sequence<T>&&>(*this).get_next_function() } };
+        return aggregate_with(static_cast<sequence<T>&&>(*this).get_next_function(), key_fn, init, combine);
     }
-};
 
-template <class T>
-struct drop_while_indexed_mixin
-{
-    template <class Pred>
-    struct next_function
+    template <class KeyFn>
+    auto group_by(KeyFn key_fn) const& -> flat_hash_map<key_t<KeyFn>, std::vector<std::decay_t<T>>>
     {
-        Pred m_pred;
-        next_function_t<T> m_next;
-        mutable bool m_init = true;
-        mutable std::ptrdiff_t m_index = 0;
+        return aggregate_by(std::move(key_fn), std::vector<std::decay_t<T>>{}, append{});
+    }
 
-        auto operator()() const -> iteration_result_t<T>
+    template <class KeyFn>
+    auto group_by(KeyFn key_fn) && -> flat_hash_map<key_t<KeyFn>, std::vector<std::decay_t<T>>>
+    {
+        return std::move(*this).aggregate_by(std::move(key_fn), std::vector<std::decay_t<T>>{}, append{});
+    }
+
+    template <class KeyFn, class Acc, class Combine>
+    struct partial_next_function
+    {
+        next_function_t<T> m_next;
+        KeyFn m_key_fn;
+        Acc m_init;
+        Combine m_combine;
+        std::size_t m_max_groups;
+        mutable flat_hash_map<key_t<KeyFn>, Acc> m_groups = {};
+        mutable std::size_t m_index = 0;
+        mutable iteration_result_t<T> m_pending = {};
+
+        auto operator()() const -> iteration_result_t<std::pair<key_t<KeyFn>, Acc>>
         {
-            if (m_init)
+            if (m_index == m_groups.size())
             {
-                while (true)
+                m_groups.clear();
+                m_index = 0;
+                aggregate_into(m_next, m_pending, m_groups, m_key_fn, m_init, m_combine, m_max_groups);
+                if (m_groups.empty())
                 {
-                    iteration_result_t<T> res = m_next();
-                    if (!res)
-                    {
-                        return {};
-                    }
-                    if (!std::invoke(m_pred, m_index++, *res))
-                    {
-                        m_init = false;
-                        return res;
-                    }
+                    return {};
                 }
             }
-            return m_next();
+            return std::move(*(m_groups.begin() + static_cast<std::ptrdiff_t>(m_index++)));
         }
     };
 
-    template <class Pred>
-    auto drop_while_indexed(Pred&& pred) const& -> sequence<T>
+    // Aggregates like aggregate_by, but keeps at most max_groups groups in memory: once the table is full and an
+    // element of a new group arrives, the partial aggregates are yielded and the table is reused. The same key may
+    // therefore be yielded more than once; merging the partial aggregates is up to the caller.
+    template <class KeyFn, class Acc, class Combine>
+    auto partial_aggregate_by(std::size_t max_groups, KeyFn key_fn, Acc init, Combine combine) const&
+        -> sequence<std::pair<key_t<KeyFn>, Acc>>
     {
-        return sequence<T>{ next_function<std::decay_t<Pred>>{
-            std::forward<Pred>(pred), static_cast<const sequence<T>&>(*this).get_next_function() } };
+        return sequence<std::pair<key_t<KeyFn>, Acc>>{ partial_next_function<KeyFn, Acc, Combine>{
+            static_cast<const sequence<T>&>(*this).get_next_function(),
+            std::move(key_fn),
+            std::move(init),
+            std::move(combine),
+            std::max<std::size_t>(max_groups, 1) } };
     }
 
-    template <class Pred>
-    auto drop_while_indexed(Pred&& pred) && -> sequence<T>
+    template <class KeyFn, class Acc, class Combine>
+    auto partial_aggregate_by(std::size_t max_groups, KeyFn key_fn, Acc init, Combine combine) &&
+        -> sequence<std::pair<key_t<KeyFn>, Acc>>
     {
-        return sequence<T>{ next_function<std::decay_t<Pred>>{ std::forward<Pred>(pred),
-                                                               static_cast<sequence<T>&&>(*this).get_next_function() } };
+        return sequence<std::pair<key_t<KeyFn>, Acc>>{ partial_next_function<KeyFn, Acc, Combine>{
+            static_cast<sequence<T>&&>(*this).get_next_function(),
+            std::move(key_fn),
+            std::move(init),
+            std::move(combine),
+            std::max<std::size_t>(max_groups, 1) } };
     }
-};
 
-template <class T>
-struct take_while_mixin
-{
-    template <class Pred>
-    struct next_function
+private:
+    struct append
     {
-        Pred m_pred;
-        next_function_t<T> m_next;
-
-        auto operator()() const -> iteration_result_t<T>
+        template <class Vec, class Item>
+        auto operator()(Vec vec, Item&& item) const -> Vec
         {
-            iteration_result_t<T> res = m_next();
-            if (!(res && std::invoke(m_pred, *res)))
-            {
-                return {};
-            }
-            return res;
+            vec.push_back(std::forward<Item>(item));
+            return vec;
         }
     };
 
-    template <class Pred>
-    auto take_while(Pred&& pred) const& -> sequence<T>
+    template <class KeyFn, class Acc, class Combine>
+    static void reserve_groups(
+        const next_function_t<T>& next_fn, flat_hash_map<key_t<KeyFn>, Acc>& groups, std::size_t max_groups)
     {
-        return sequence<T>{ next_function<std::decay_t<Pred>>{
-            std::forward<Pred>(pred), static_cast<const sequence<T>&>(*this).get_next_function() } };
+        const size_hint_t hint = next_fn.size_hint();
+        groups.reserve(std::min({ hint.upper ? *hint.upper : hint.lower, max_groups, aggregate_presize_limit }));
     }
 
-    template <class Pred>
-    auto take_while(Pred&& pred) && -> sequence<T>
+    template <class KeyFn, class Acc, class Combine, class Item>
+    static void combine_into(
+        flat_hash_map<key_t<KeyFn>, Acc>& groups, key_t<KeyFn> key, const Acc& init, Combine& combine, Item&& item)
     {
-        return sequence<T>{ next_function<std::decay_t<Pred>>{ std::forward<Pred>(pred),
-                                                               static_cast<sequence<T>&&>(*this).get_next_function() } };
+        auto found = groups.try_emplace(std::move(key), init).first;
+        found->second = std::invoke(combine, std::move(found->second), std::forward<Item>(item));
     }
-};
 
-template <class T>
-struct take_while_indexed_mixin
-{
-    template <class Pred>
-    struct next_function
+    // Aggregates into groups until the sequence ends or an element of a new group arrives while max_groups groups
+    // are held. Such an element is left in pending and opens the next round.
+    template <class KeyFn, class Acc, class Combine>
+    static void aggregate_into(
+        const next_function_t<T>& next_fn,
+        iteration_result_t<T>& pending,
+        flat_hash_map<key_t<KeyFn>, Acc>& groups,
+        KeyFn& key_fn,
+        const Acc& init,
+        Combine& combine,
+        std::size_t max_groups)
     {
-        Pred m_pred;
-        next_function_t<T> m_next;
-        mutable std::ptrdiff_t m_index = 0;
-
-        auto operator()() const -> iteration_result_t<T>
+        if (groups.capacity() == 0)
         {
-            iteration_result_t<T> res = m_next();
-            if (!(res && std::invoke(m_pred, m_index++, *res)))
+            reserve_groups<KeyFn, Acc, Combine>(next_fn, groups, max_groups);
+        }
+        while (true)
+        {
+            iteration_result_t<T> next = std::move(pending);
+            pending = {};
+            if (!next)
             {
-                return {};
+                next = next_fn();
             }
-            return res;
+            if (!next)
+            {
+                return;
+            }
+            key_t<KeyFn> key = std::invoke(key_fn, *next);
+            if (groups.size() == max_groups && !groups.contains(key))
+            {
+                pending = std::move(next);
+                return;
+            }
+            combine_into<KeyFn>(groups, std::move(key), init, combine, *std::move(next));
         }
-    };
-
-    template <class Pred>
-    auto take_while_indexed(Pred&& pred) const& -> sequence<T>
-    {
-        return sequence<T>{ next_function<std::decay_t<Pred>>{
-            std::forward<Pred>(pred), static_cast<const sequence<T>&>(*this).get_next_function() } };
     }
 
-    template <class Pred>
-    auto take_while_indexed(Pred&& pred) && -> sequence<T>
+    template <class KeyFn, class Acc, class Combine>
+    static auto aggregate_with(next_function_t<T> next_fn, KeyFn& key_fn, const Acc& init, Combine& combine)
+        -> flat_hash_map<key_t<KeyFn>, Acc>
     {
-        return sequence<T>{ next_function<std::decay_t<Pred>>{ std::forward<Pred>(pred),
-                                                               static_cast<sequence<T>&&>(*this).get_next_function() } };
+        flat_hash_map<key_t<KeyFn>, Acc> groups;
+        reserve_groups<KeyFn, Acc, Combine>(next_fn, groups, std::numeric_limits<std::size_t>::max());
+        detail::for_each_pushed(
+            next_fn,
+            [&](auto&& item)
+            {
+                key_t<KeyFn> key = std::invoke(key_fn, item);
+                combine_into<KeyFn>(groups, std::move(key), init, combine, std::forward<decltype(item)>(item));
+            });
+        return groups;
     }
 };
 
 template <class T>
-struct drop_mixin
+struct prefetch_mixin
 {
-    struct next_function
+    using prefetched_type = std::decay_t<T>;
+
+    // Runs the upstream stages on a dedicated thread, which hands batches of values to the consumer through a
+    // bounded channel. Destroying the worker closes the channel, which makes the producer stop at its next push,
+    // and joins the thread; a pull already in progress upstream is waited for.
+    struct worker
     {
-        mutable std::ptrdiff_t m_count;
-        next_function_t<T> m_next;
-        mutable bool m_init = false;
+        channel<std::vector<prefetched_type>> m_channel;
+        std::exception_ptr m_error = {};
+        std::thread m_thread;
 
-        auto operator()() const -> iteration_result_t<T>
+        worker(next_function_t<T> source, std::size_t capacity, std::size_t batch_size)
+            : m_channel(capacity)
+            , m_thread([this, source = std::move(source), batch_size]() { run(source, batch_size); })
         {
-            if (!m_init)
+        }
+
+        worker(const worker&) = delete;
+        worker& operator=(const worker&) = delete;
+
+        ~worker()
+        {
+            m_channel.close();
+            m_thread.join();
+        }
+
+        void run(const next_function_t<T>& source, std::size_t batch_size)
+        {
+            try
             {
-                while (m_count > 0)
+                std::vector<iteration_result_t<T>> batch(batch_size);
+                while (const std::size_t count = source.next_batch(batch.data(), batch.size()))
                 {
-                    --m_count;
-                    m_next();
+                    std::vector<prefetched_type> values;
+                    values.reserve(count);
+                    for (std::size_t i = 0; i < count; ++i)
+                    {
+                        values.push_back(*std::move(batch[i]));
+                    }
+                    m_channel.push(std::move(values));
                 }
-                m_init = true;
             }
-            return m_next();
+            catch (...)
+            {
+                // A push to a channel closed by the consumer is not an error.
+                if (!m_channel.is_closed())
+                {
+                    m_error = std::current_exception();
+                }
+            }
+            m_channel.close();
         }
     };
 
-    auto drop(std::ptrdiff_t n) const& -> sequence<T>
+    // The worker, with the batch being consumed, shared by the copies of a started stage.
+    struct consumer
     {
-        return sequence<T>{ next_function{ n, static_cast<const sequence<T>&>(*this).get_next_function() } };
-    }
+        worker m_worker;
+        std::vector<prefetched_type> m_batch = {};
+        std::size_t m_pos = 0;
 
-    auto drop(std::ptrdiff_t n) && -> sequence<T>
-    {
-        return sequence<T>{ next_function{ n, static_cast<sequence<T>&&>(*this).get_next_function() } };
-    }
-};
+        consumer(next_function_t<T> source, std::size_t capacity, std::size_t batch_size)
+            : m_worker(std::move(source), capacity, batch_size)
+        {
+        }
 
-template <class T>
-struct take_mixin
-{
+        auto refill() -> bool
+        {
+            if (m_pos < m_batch.size())
+            {
+                return true;
+            }
+            std::optional<std::vector<prefetched_type>> next = m_worker.m_channel.pop();
+            if (!next)
+            {
+                if (m_worker.m_error)
+                {
+                    std::rethrow_exception(m_worker.m_error);
+                }
+                return false;
+            }
+            m_batch = std::move(*next);
+            m_pos = 0;
+            return true;
+        }
+    };
+
+    // The worker is started by the first pull. Copies made before that run their own worker; copies of a started
+    // stage share it with the current batch, and so split the remaining elements between them. They must not be
+    // pulled concurrently.
     struct next_function
     {
-        mutable std::ptrdiff_t m_count;
-        next_function_t<T> m_next;
+        mutable next_function_t<T> m_source;
+        std::size_t m_capacity;
+        std::size_t m_batch_size;
+        mutable std::shared_ptr<consumer> m_consumer = {};
 
-        auto operator()() const -> iteration_result_t<T>
+        auto refill() const -> bool
+        {
+            if (!m_consumer)
+            {
+                m_consumer = std::make_shared<consumer>(std::move(m_source), m_capacity, m_batch_size);
+            }
+            return m_consumer->refill();
+        }
+
+        auto operator()() const -> iteration_result_t<prefetched_type>
         {
-            if (m_count == 0)
+            if (!refill())
             {
                 return {};
             }
-            --m_count;
-            return m_next();
+            return std::move(m_consumer->m_batch[m_consumer->m_pos++]);
+        }
+
+        auto next_batch(iteration_result_t<prefetched_type>* out, std::size_t n) const -> std::size_t
+        {
+            if (!refill())
+            {
+                return 0;
+            }
+            consumer& state = *m_consumer;
+            const std::size_t count = std::min(n, state.m_batch.size() - state.m_pos);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                out[i] = std::move(state.m_batch[state.m_pos + i]);
+            }
+            state.m_pos += count;
+            return count;
+        }
+
+        auto push(sink_ref<prefetched_type> sink) const -> bool
+        {
+            while (refill())
+            {
+                consumer& state = *m_consumer;
+                while (state.m_pos < state.m_batch.size())
+                {
+                    if (!sink(std::move(state.m_batch[state.m_pos++])))
+                    {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            if (!m_consumer)
+            {
+                return m_source.size_hint();
+            }
+            return size_hint_t{ m_consumer->m_batch.size() - m_consumer->m_pos, {} };
         }
     };
 
-    auto take(std::ptrdiff_t n) const& -> sequence<T>
+    // Overlaps the upstream stages with the downstream ones: up to capacity elements are produced ahead on a
+    // separate thread. Elements are yielded as values.
+    auto prefetch(std::size_t capacity) const& -> sequence<prefetched_type>
     {
-        return sequence<T>{ next_function{ n, static_cast<const sequence<T>&>(*this).get_next_function() } };
+        return sequence<prefetched_type>{ make_next_function(
+            static_cast<const sequence<T>&>(*this).get_next_function(), capacity) };
     }
 
-    auto take(std::ptrdiff_t n) && -> sequence<T>
+    auto prefetch(std::size_t capacity) && -> sequence<prefetched_type>
     {
-        return sequence<T>{ next_function{ n, static_cast<sequence<T>&&>(*this).get_next_function() } };
+        return sequence<prefetched_type>{ make_next_function(
+            static_cast<sequence<T>&&>(*this).get_next_function(), capacity) };
+    }
+
+private:
+    static auto make_next_function(next_function_t<T> source, std::size_t capacity) -> next_function
+    {
+        static_assert(!is_transient<prefetched_type>::value, "transient elements cannot be prefetched");
+        const std::size_t batch_size = std::clamp<std::size_t>(capacity, 1, default_batch_size);
+        const std::size_t batch_count = std::max<std::size_t>(1, capacity / batch_size);
+        return next_function{ std::move(source), batch_count, batch_size };
     }
 };
 
 template <class T>
-struct step_mixin
+struct profile_mixin
 {
+    // Accounts every pull and push to the record of the profile point; the parts of a split are accounted to it as
+    // well. The contiguous fast path is not forwarded, so that the elements are counted; elements skipped by advance
+    // are not.
     struct next_function
     {
-        mutable std::ptrdiff_t m_count;
         next_function_t<T> m_next;
-        mutable std::ptrdiff_t m_index = 0;
+        std::shared_ptr<detail::profile_record> m_record;
 
         auto operator()() const -> iteration_result_t<T>
         {
-            while (true)
-            {
-                iteration_result_t<T> res = m_next();
-                if (!res)
+            iteration_result_t<T> result = {};
+            detail::profile_pull(
+                *m_record,
+                [&]() -> std::size_t
                 {
-                    break;
-                }
+                    result = m_next();
+                    return result ? 1 : 0;
+                });
+            return result;
+        }
 
-                if (m_index++ % m_count == 0)
+        auto next_batch(iteration_result_t<T>* out, std::size_t n) const -> std::size_t
+        {
+            return detail::profile_pull(*m_record, [&]() { return m_next.next_batch(out, n); });
+        }
+
+        auto push(sink_ref<T> sink) const -> bool
+        {
+            return detail::profile_push(
+                *m_record,
+                [&](auto&& downstream)
                 {
-                    return res;
-                }
-            }
-            return {};
+                    return detail::push_to(
+                        m_next, [&](T&& item) { return downstream([&]() { return sink(std::forward<T>(item)); }); });
+                });
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return m_next.size_hint();
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            return m_next.advance(n);
+        }
+
+        auto split(std::size_t parts) const -> std::vector<next_function_t<T>>
+        {
+            return detail::split_each<T>(
+                m_next, parts, [&](next_function_t<T> part) { return next_function{ std::move(part), m_record }; });
         }
     };
 
-    auto step(std::ptrdiff_t n) const& -> sequence<T>
+    // Marks the end of a stage: the statistics of the stages between this and the previous profile point are recorded
+    // under name (see print_profile and write_profile_trace). Unless profiling is enabled (see enable_profiling), the
+    // sequence is returned unchanged.
+    auto profile(const std::string& name) const& -> sequence<T>
     {
-        return sequence<T>{ next_function{ n, static_cast<const sequence<T>&>(*this).get_next_function() } };
+        if (!is_profiling_enabled())
+        {
+            return static_cast<const sequence<T>&>(*this);
+        }
+        return sequence<T>{ next_function{ static_cast<const sequence<T>&>(*this).get_next_function(),
+                                           detail::profile_registry::instance().get(name) } };
     }
 
-    auto step(std::ptrdiff_t n) && -> sequence<T>
+    auto profile(const std::string& name) && -> sequence<T>
     {
-        return sequence<T>{ next_function{ n, static_cast<sequence<T>&&>(*this).get_next_function() } };
+        if (!is_profiling_enabled())
+        {
+            return static_cast<sequence<T>&&>(*this);
+        }
+        return sequence<T>{ next_function{ static_cast<sequence<T>&&>(*this).get_next_function(),
+                                           detail::profile_registry::instance().get(name) } };
     }
 };
 
@@ -648,57 +3620,422 @@ struct join_mixin<sequence<T>>
                     continue;
                 }
             }
-            return {};
+            return {};
+        }
+    };
+
+    auto join() const& -> sequence<T>
+    {
+        return sequence<T>{ next_function{ static_cast<const sequence<sequence<T>>&>(*this).get_next_function() } };
+    }
+
+    auto join() && -> sequence<T>
+    {
+        return sequence<T>{ next_function{ static_cast<sequence<sequence<T>>&&>(*this).get_next_function() } };
+    }
+};
+
+template <class T>
+struct for_each_mixin
+{
+    template <class Func>
+    void for_each(Func&& func) const&
+    {
+        const auto next_function = static_cast<const sequence<T>&>(*this).get_next_function();
+        detail::for_each_pushed(next_function, func);
+    }
+
+    template <class Func>
+    void for_each(Func&& func) &&
+    {
+        const auto next_function = static_cast<sequence<T>&&>(*this).get_next_function();
+        detail::for_each_pushed(next_function, func);
+    }
+
+    // Hands every element to each of the sinks in a single pass, and returns the sinks, e.g. to read the state they
+    // accumulated.
+    template <class... Sinks>
+    auto fork_to(Sinks... sinks) const& -> std::tuple<Sinks...>
+    {
+        const auto next_function = static_cast<const sequence<T>&>(*this).get_next_function();
+        detail::for_each_pushed(next_function, [&](auto&& item) { (std::invoke(sinks, std::as_const(item)), ...); });
+        return std::tuple<Sinks...>{ std::move(sinks)... };
+    }
+
+    template <class... Sinks>
+    auto fork_to(Sinks... sinks) && -> std::tuple<Sinks...>
+    {
+        const auto next_function = static_cast<sequence<T>&&>(*this).get_next_function();
+        detail::for_each_pushed(next_function, [&](auto&& item) { (std::invoke(sinks, std::as_const(item)), ...); });
+        return std::tuple<Sinks...>{ std::move(sinks)... };
+    }
+};
+
+template <class T>
+struct for_each_indexed_mixin
+{
+    template <class Func>
+    void for_each_indexed(Func&& func) const&
+    {
+        const auto next_function = static_cast<const sequence<T>&>(*this).get_next_function();
+        std::ptrdiff_t index = 0;
+        detail::for_each_pushed(
+            next_function, [&](auto&& item) { std::invoke(func, index++, std::forward<decltype(item)>(item)); });
+    }
+};
+
+struct parallel_options
+{
+    // Number of worker threads including the calling one; 0 means std::thread::hardware_concurrency().
+    std::size_t threads = 0;
+    // Number of elements pulled from the upstream at once by a worker.
+    std::size_t chunk_size = default_batch_size;
+};
+
+namespace detail
+{
+
+inline auto parallel_thread_count(const parallel_options& options) -> std::size_t
+{
+    return std::max<std::size_t>(1, options.threads != 0 ? options.threads : std::thread::hardware_concurrency());
+}
+
+// Threads shared by the parallel terminals; they are started on demand and kept for the following calls. A call
+// queues helper tasks and runs one task itself. When it is done, it withdraws the helpers which no thread has
+// started yet and waits only for the running ones. So a parallel call nested in another one never waits for a busy
+// thread, and a failure to start a thread only means less parallelism.
+class worker_pool
+{
+public:
+    static auto instance() -> worker_pool&
+    {
+        static worker_pool pool;
+        return pool;
+    }
+
+    worker_pool() = default;
+    worker_pool(const worker_pool&) = delete;
+    worker_pool& operator=(const worker_pool&) = delete;
+
+    ~worker_pool()
+    {
+        {
+            std::scoped_lock lock(m_mutex);
+            m_stopping = true;
+        }
+        m_task_added.notify_all();
+        for (std::thread& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    // Calls task(i) for every i in [0, count): task(0) on the calling thread, the other ones on the threads of the
+    // pool which become available before task(0) returns. task must not throw.
+    template <class Task>
+    void run(std::size_t count, Task& task)
+    {
+        std::vector<queued_task> helpers;
+        helpers.reserve(count - 1);
+        for (std::size_t i = 1; i < count; ++i)
+        {
+            helpers.push_back(queued_task{ &call<Task>, std::addressof(task), i });
+        }
+        {
+            std::scoped_lock lock(m_mutex);
+            try
+            {
+                for (queued_task& helper : helpers)
+                {
+                    m_queue.push_back(&helper);
+                }
+            }
+            catch (...)
+            {
+                withdraw(helpers);
+                throw;
+            }
+            start_threads(helpers.size());
+        }
+        m_task_added.notify_all();
+
+        task(std::size_t{ 0 });
+
+        std::unique_lock lock(m_mutex);
+        withdraw(helpers);
+        m_task_finished.wait(
+            lock,
+            [&]()
+            {
+                return std::all_of(
+                    helpers.begin(),
+                    helpers.end(),
+                    [&](const queued_task& t) { return t.m_finished || !t.m_started; });
+            });
+    }
+
+private:
+    struct queued_task
+    {
+        void (*m_call)(void*, std::size_t);
+        void* m_task;
+        std::size_t m_index;
+        bool m_started = false;
+        bool m_finished = false;
+    };
+
+    template <class Task>
+    static void call(void* task, std::size_t index)
+    {
+        (*static_cast<Task*>(task))(index);
+    }
+
+    // Called under the lock.
+    void withdraw(const std::vector<queued_task>& helpers)
+    {
+        const queued_task* const first = helpers.data();
+        const queued_task* const last = first + helpers.size();
+        m_queue.erase(
+            std::remove_if(m_queue.begin(), m_queue.end(), [&](const queued_task* t) { return first <= t && t < last; }),
+            m_queue.end());
+    }
+
+    // Called under the lock.
+    void start_threads(std::size_t count)
+    {
+        while (m_threads.size() < count)
+        {
+            try
+            {
+                m_threads.emplace_back([this]() { work(); });
+            }
+            catch (const std::system_error&)
+            {
+                return;
+            }
+        }
+    }
+
+    void work()
+    {
+        std::unique_lock lock(m_mutex);
+        while (true)
+        {
+            m_task_added.wait(lock, [&]() { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty())
+            {
+                return;
+            }
+            queued_task* const t = m_queue.front();
+            m_queue.pop_front();
+            t->m_started = true;
+            lock.unlock();
+            t->m_call(t->m_task, t->m_index);
+            lock.lock();
+            t->m_finished = true;
+            m_task_finished.notify_all();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_task_added;
+    std::condition_variable m_task_finished;
+    std::deque<queued_task*> m_queue;
+    std::vector<std::thread> m_threads;
+    bool m_stopping = false;
+};
+
+// Position of a chunk in the sequence: the index of the part it belongs to, and its index within the part.
+using chunk_id = std::pair<std::size_t, std::size_t>;
+
+// Calls func(worker_index, chunk_id, elements, count) on the chunks of the sequence, on up to the requested number of
+// threads of the worker pool. When the pipeline can be split (see any_next_function::split), the remaining elements
+// are divided into a few parts per thread, and the workers take the parts in turn and run their own copies of the
+// stages, so the upstream stages run in parallel too; only stages whose callables are stateless split, so the copies
+// share nothing but the source. Otherwise the workers take turns pulling chunks from the shared upstream under a
+// lock, and only func runs in parallel.
+template <class T, class ChunkFunc>
+void for_each_chunk_parallel(const next_function_t<T>& next_fn, const parallel_options& options, ChunkFunc&& func)
+{
+    static_assert(!is_transient<std::decay_t<T>>::value, "transient elements cannot be processed in parallel");
+    static constexpr std::size_t parts_per_thread = 4;
+    const std::size_t thread_count = parallel_thread_count(options);
+    const std::size_t chunk_size = std::max<std::size_t>(1, options.chunk_size);
+    const std::vector<next_function_t<T>> parts
+        = thread_count > 1 ? next_fn.split(thread_count * parts_per_thread) : std::vector<next_function_t<T>>{};
+
+    std::mutex mutex;
+    std::atomic<std::size_t> next_part_index{ 0 };
+    std::size_t next_chunk_index = 0;
+    std::atomic<bool> done{ false };
+    std::exception_ptr error;
+
+    // Returns the number of elements pulled into the chunk, and its id.
+    const auto pull_chunk = [&](std::size_t& part_index, std::size_t& chunk_index, iteration_result_t<T>* chunk)
+        -> std::pair<std::size_t, chunk_id>
+    {
+        if (parts.empty())
+        {
+            std::scoped_lock lock(mutex);
+            if (done)
+            {
+                return {};
+            }
+            const std::size_t count = next_fn.next_batch(chunk, chunk_size);
+            if (count == 0)
+            {
+                done = true;
+                return {};
+            }
+            return { count, chunk_id{ 0, next_chunk_index++ } };
+        }
+        while (!done && part_index < parts.size())
+        {
+            if (const std::size_t count = parts[part_index].next_batch(chunk, chunk_size))
+            {
+                return { count, chunk_id{ part_index, chunk_index++ } };
+            }
+            part_index = next_part_index++;
+            chunk_index = 0;
+        }
+        return {};
+    };
+
+    auto worker = [&](std::size_t worker_index)
+    {
+        std::size_t part_index = next_part_index++;
+        std::size_t chunk_index = 0;
+        try
+        {
+            std::vector<iteration_result_t<T>> chunk(chunk_size);
+            while (true)
+            {
+                const auto [count, id] = pull_chunk(part_index, chunk_index, chunk.data());
+                if (count == 0)
+                {
+                    return;
+                }
+                func(worker_index, id, chunk.data(), count);
+            }
+        }
+        catch (...)
+        {
+            std::scoped_lock lock(mutex);
+            done = true;
+            if (!error)
+            {
+                error = std::current_exception();
+            }
         }
     };
 
-    auto join() const& -> sequence<T>
+    worker_pool::instance().run(thread_count, worker);
+    if (error)
     {
-        return sequence<T>{ next_function{ static_cast<const sequence<sequence<T>>&>(*this).get_next_function() } };
+        std::rethrow_exception(error);
     }
+}
 
-    auto join() && -> sequence<T>
+template <class R>
+auto collect_chunks_in_order(std::vector<std::vector<std::pair<chunk_id, R>>> per_worker)
+    -> std::vector<std::pair<chunk_id, R>>
+{
+    std::vector<std::pair<chunk_id, R>> result;
+    for (auto& chunks : per_worker)
     {
-        return sequence<T>{ next_function{ static_cast<sequence<sequence<T>>&&>(*this).get_next_function() } };
+        std::move(chunks.begin(), chunks.end(), std::back_inserter(result));
     }
-};
+    std::sort(result.begin(), result.end(), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+    return result;
+}
+
+}  // namespace detail
 
+// The parallel terminals run func concurrently, and also the callables of the upstream stages when the pipeline
+// splits, which it only does when these are stateless: captureless lambdas, empty function objects and function
+// pointers (see detail::is_stateless). Stages with stateful or capturing callables run under a lock, one chunk at a
+// time.
 template <class T>
-struct for_each_mixin
+struct parallel_mixin
 {
+    // Calls func for every element on a pool of worker threads. The order of the calls is unspecified.
     template <class Func>
-    void for_each(Func&& func) const&
+    void par_for_each(Func&& func, const parallel_options& options = {}) const&
     {
         const auto next_function = static_cast<const sequence<T>&>(*this).get_next_function();
-        while (true)
-        {
-            const iteration_result_t<T> next = next_function();
-            if (!next)
+        detail::for_each_chunk_parallel(
+            next_function,
+            options,
+            [&](std::size_t, detail::chunk_id, iteration_result_t<T>* chunk, std::size_t count)
             {
-                break;
-            }
-            std::invoke(func, *next);
-        }
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    std::invoke(func, *std::move(chunk[i]));
+                }
+            });
     }
-};
 
-template <class T>
-struct for_each_indexed_mixin
-{
-    template <class Func>
-    void for_each_indexed(Func&& func) const&
+    // Reduces the sequence in parallel. func must be associative, identity must be its neutral element and func must
+    // also accept two partial results. Partial results are combined in the order of the elements, so func does not
+    // need to be commutative.
+    template <class Seed, class BinaryFunc>
+    auto par_accumulate(Seed identity, BinaryFunc&& func, const parallel_options& options = {}) const& -> Seed
     {
         const auto next_function = static_cast<const sequence<T>&>(*this).get_next_function();
-        std::ptrdiff_t index = 0;
-        while (true)
+        std::vector<std::vector<std::pair<detail::chunk_id, Seed>>> partials(detail::parallel_thread_count(options));
+        detail::for_each_chunk_parallel(
+            next_function,
+            options,
+            [&](std::size_t worker_index, detail::chunk_id id, iteration_result_t<T>* chunk, std::size_t count)
+            {
+                Seed partial = identity;
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    partial = std::invoke(func, std::move(partial), *std::move(chunk[i]));
+                }
+                partials[worker_index].emplace_back(id, std::move(partial));
+            });
+
+        Seed result = std::move(identity);
+        for (auto& [id, partial] : detail::collect_chunks_in_order(std::move(partials)))
         {
-            const iteration_result_t<T> next = next_function();
-            if (!next)
+            result = std::invoke(func, std::move(result), std::move(partial));
+        }
+        return result;
+    }
+
+    // Applies func to every element in parallel and collects the results preserving the order of the elements.
+    template <class Func, class Res = std::decay_t<std::invoke_result_t<Func, T>>>
+    auto par_to_vector(Func&& func, const parallel_options& options = {}) const& -> std::vector<Res>
+    {
+        const auto next_function = static_cast<const sequence<T>&>(*this).get_next_function();
+        std::vector<std::vector<std::pair<detail::chunk_id, std::vector<Res>>>> chunks(
+            detail::parallel_thread_count(options));
+        detail::for_each_chunk_parallel(
+            next_function,
+            options,
+            [&](std::size_t worker_index, detail::chunk_id id, iteration_result_t<T>* chunk, std::size_t count)
             {
-                break;
-            }
-            std::invoke(func, index++, *next);
+                std::vector<Res> results;
+                results.reserve(count);
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    results.push_back(std::invoke(func, *std::move(chunk[i])));
+                }
+                chunks[worker_index].emplace_back(id, std::move(results));
+            });
+
+        std::vector<Res> result;
+        for (auto& [id, results] : detail::collect_chunks_in_order(std::move(chunks)))
+        {
+            std::move(results.begin(), results.end(), std::back_inserter(result));
         }
+        return result;
+    }
+
+    auto par_to_vector(const parallel_options& options = {}) const& -> std::vector<std::decay_t<T>>
+    {
+        return par_to_vector([](auto&& item) -> std::decay_t<T> { return std::forward<decltype(item)>(item); }, options);
     }
 };
 
@@ -709,6 +4046,16 @@ struct empty_sequence
     {
         return {};
     }
+
+    auto size_hint() const -> size_hint_t
+    {
+        return size_hint_t::exact(0);
+    }
+
+    auto advance(std::size_t) const -> std::size_t
+    {
+        return 0;
+    }
 };
 
 template <class To, class From>
@@ -725,6 +4072,27 @@ struct cast_sequence
         }
         return {};
     }
+
+    auto push(sink_ref<To> sink) const -> bool
+    {
+        return detail::push_to(m_from, [&](From&& item) { return sink(static_cast<To>(item)); });
+    }
+
+    auto size_hint() const -> size_hint_t
+    {
+        return m_from.size_hint();
+    }
+
+    auto advance(std::size_t n) const -> std::size_t
+    {
+        return m_from.advance(n);
+    }
+
+    auto split(std::size_t parts) const -> std::vector<next_function_t<To>>
+    {
+        return detail::split_each<To>(
+            m_from, parts, [](next_function_t<From> part) { return cast_sequence{ std::move(part) }; });
+    }
 };
 
 template <class Iter, class Out>
@@ -741,6 +4109,96 @@ struct view_sequence
         }
         return *m_iter++;
     }
+
+    auto next_batch(iteration_result_t<Out>* out, std::size_t n) const -> std::size_t
+    {
+        std::size_t count = 0;
+        for (; count < n && m_iter != m_end; ++count, ++m_iter)
+        {
+            out[count] = *m_iter;
+        }
+        return count;
+    }
+
+    auto push(sink_ref<Out> sink) const -> bool
+    {
+        while (m_iter != m_end)
+        {
+            if (!sink(static_cast<Out>(*m_iter++)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    auto size_hint() const -> size_hint_t
+    {
+        if constexpr (is_random_access_iterator<Iter>::value)
+        {
+            return size_hint_t::exact(static_cast<std::size_t>(std::distance(m_iter, m_end)));
+        }
+        else
+        {
+            return size_hint_t{ m_iter == m_end ? 0u : 1u, {} };
+        }
+    }
+
+    auto advance(std::size_t n) const -> std::size_t
+    {
+        if constexpr (is_random_access_iterator<Iter>::value)
+        {
+            const auto count = std::min(n, static_cast<std::size_t>(std::distance(m_iter, m_end)));
+            m_iter += static_cast<iter_difference_t<Iter>>(count);
+            return count;
+        }
+        else
+        {
+            std::size_t count = 0;
+            for (; count < n && m_iter != m_end; ++count)
+            {
+                ++m_iter;
+            }
+            return count;
+        }
+    }
+
+    auto contiguous() const -> maybe<span<std::decay_t<Out>>>
+    {
+        using value_type = std::decay_t<Out>;
+        if constexpr (
+            std::is_lvalue_reference_v<Out> && detail::is_contiguous_iterator<Iter>::value
+            && std::is_same_v<value_type, std::remove_cv_t<iter_value_t<Iter>>>)
+        {
+            if (m_iter == m_end)
+            {
+                return span<value_type>{};
+            }
+            const value_type* data = std::addressof(*m_iter);
+            return span<value_type>{ data, data + std::distance(m_iter, m_end) };
+        }
+        else
+        {
+            return {};
+        }
+    }
+
+    auto split(std::size_t parts) const -> std::vector<next_function_t<Out>>
+    {
+        std::vector<next_function_t<Out>> result;
+        if constexpr (is_random_access_iterator<Iter>::value)
+        {
+            const auto count = static_cast<std::size_t>(std::distance(m_iter, m_end));
+            parts = std::min(parts, count);
+            for (std::size_t i = 0; i < parts; ++i)
+            {
+                const auto [begin, end] = detail::part_bounds(count, parts, i);
+                result.emplace_back(view_sequence{ m_iter + static_cast<iter_difference_t<Iter>>(begin),
+                                                   m_iter + static_cast<iter_difference_t<Iter>>(end) });
+            }
+        }
+        return result;
+    }
 };
 
 template <class T>
@@ -754,6 +4212,8 @@ struct pointer_proxy
     }
 };
 
+// Iterators of the same pass share the pipeline state, so copying one is O(1) and never allocates. As a consequence
+// advancing an iterator consumes the shared state and invalidates its copies: sequence iterators are input iterators.
 template <class T>
 struct sequence_iterator
 {
@@ -763,9 +4223,9 @@ struct sequence_iterator
     using value_type = std::decay_t<reference>;
     using pointer
         = std::conditional_t<std::is_reference_v<reference>, std::add_pointer_t<reference>, pointer_proxy<reference>>;
-    using iterator_category = std::forward_iterator_tag;
+    using iterator_category = std::input_iterator_tag;
 
-    next_function_type m_next_fn;
+    std::shared_ptr<const next_function_type> m_next_fn;
     iteration_result_t<reference> m_current;
     difference_type m_index;
 
@@ -773,18 +4233,18 @@ struct sequence_iterator
     {
     }
 
-    sequence_iterator(const next_function_type& next_fn) : m_next_fn{ next_fn }, m_current{ m_next_fn() }, m_index{ 0 }
+    sequence_iterator(next_function_type next_fn)
+        : m_next_fn{ std::make_shared<const next_function_type>(std::move(next_fn)) }
+        , m_current{ (*m_next_fn)() }
+        , m_index{ 0 }
     {
     }
 
     sequence_iterator(const sequence_iterator&) = default;
     sequence_iterator(sequence_iterator&&) noexcept = default;
 
-    sequence_iterator& operator=(sequence_iterator other)
-    {
-        std::swap(m_next_fn, m_next_fn);
-        return *this;
-    }
+    sequence_iterator& operator=(const sequence_iterator&) = default;
+    sequence_iterator& operator=(sequence_iterator&&) noexcept = default;
 
     reference operator*() const
     {
@@ -805,7 +4265,7 @@ struct sequence_iterator
 
     sequence_iterator& operator++()
     {
-        m_current = m_next_fn();
+        m_current = (*m_next_fn)();
         ++m_index;
         return *this;
     }
@@ -835,6 +4295,7 @@ struct sequence : inspect_mixin<T>,
                   transform_indexed_mixin<T>,
                   filter_mixin<T>,
                   filter_indexed_mixin<T>,
+                  distinct_mixin<T>,
                   transform_maybe_mixin<T>,
                   transform_maybe_indexed_mixin<T>,
                   drop_while_mixin<T>,
@@ -844,9 +4305,21 @@ struct sequence : inspect_mixin<T>,
                   drop_mixin<T>,
                   take_mixin<T>,
                   step_mixin<T>,
+                  window_mixin<T>,
+                  rolling_mixin<T>,
+                  split_fields_mixin<T>,
+                  numeric_mixin<T>,
+                  cache_mixin<T>,
+                  tee_mixin<T>,
+                  top_k_mixin<T>,
+                  sample_mixin<T>,
+                  aggregate_mixin<T>,
+                  prefetch_mixin<T>,
+                  profile_mixin<T>,
                   join_mixin<T>,
                   for_each_mixin<T>,
-                  for_each_indexed_mixin<T>
+                  for_each_indexed_mixin<T>,
+                  parallel_mixin<T>
 {
     using iterator = sequence_iterator<T>;
     using next_function_type = typename iterator::next_function_type;
@@ -889,9 +4362,17 @@ struct sequence : inspect_mixin<T>,
     }
 
     template <class Container, std::enable_if_t<std::is_constructible_v<Container, iterator, iterator>, int> = 0>
-    operator Container() const
+    operator Container() const&
+    {
+        return to_container<Container>(next_function_type{ m_next_fn });
+    }
+
+    template <
+        class Container,
+        std::enable_if_t<!is_sequence<Container>::value && std::is_constructible_v<Container, iterator, iterator>, int> = 0>
+    operator Container() &&
     {
-        return Container{ begin(), end() };
+        return to_container<Container>(std::move(m_next_fn));
     }
 
     auto begin() const -> iterator
@@ -914,6 +4395,25 @@ struct sequence : inspect_mixin<T>,
         return std::move(m_next_fn);
     }
 
+    // Bounds on the number of elements; materialising into a container reserves the lower bound once the upper one
+    // is known.
+    auto size_hint() const -> size_hint_t
+    {
+        return m_next_fn.size_hint();
+    }
+
+    // Number of elements. Known lengths are returned without iterating; random-access sources are skipped in O(1).
+    // Throws std::length_error if the sequence is known to be infinite.
+    auto count() const& -> std::size_t
+    {
+        return count_of(next_function_type{ m_next_fn });
+    }
+
+    auto count() && -> std::size_t
+    {
+        return count_of(std::move(m_next_fn));
+    }
+
     auto maybe_front() const& -> maybe<reference>
     {
         return get_next_function()();
@@ -924,11 +4424,16 @@ struct sequence : inspect_mixin<T>,
         return std::move(*this).get_next_function()();
     }
 
-    auto maybe_at(difference_type n) && -> maybe<reference>
+    auto maybe_at(difference_type n) const& -> maybe<reference>
     {
         return this->drop(n).maybe_front();
     }
 
+    auto maybe_at(difference_type n) && -> maybe<reference>
+    {
+        return std::move(*this).drop(n).maybe_front();
+    }
+
     template <class Pred>
     auto find_if(Pred pred) const -> maybe<reference>
     {
@@ -952,18 +4457,102 @@ struct sequence : inspect_mixin<T>,
     }
 
     template <class Output>
-    auto copy(Output out) const -> Output
+    auto copy(Output out) const& -> Output
+    {
+        return copy_to(next_function_type{ m_next_fn }, std::move(out));
+    }
+
+    template <class Output>
+    auto copy(Output out) && -> Output
+    {
+        return copy_to(std::move(m_next_fn), std::move(out));
+    }
+
+    template <class Seed, class BinaryFunc>
+    auto accumulate(Seed seed, BinaryFunc&& func) const& -> Seed
+    {
+        return accumulate_with(next_function_type{ m_next_fn }, std::move(seed), func);
+    }
+
+    template <class Seed, class BinaryFunc>
+    auto accumulate(Seed seed, BinaryFunc&& func) && -> Seed
+    {
+        return accumulate_with(std::move(m_next_fn), std::move(seed), func);
+    }
+
+private:
+    template <class Container>
+    static auto to_container(next_function_type next_fn) -> Container
+    {
+        if constexpr (is_detected<detail::push_back_impl, Container, reference>::value)
+        {
+            Container result{};
+            if constexpr (is_detected<detail::reserve_impl, Container>::value)
+            {
+                const size_hint_t hint = next_fn.size_hint();
+                if (hint.upper)
+                {
+                    result.reserve(hint.lower);
+                }
+            }
+            detail::for_each_pushed(next_fn, [&](auto&& item) { result.push_back(std::forward<decltype(item)>(item)); });
+            return result;
+        }
+        else
+        {
+            return Container{ iterator{ std::move(next_fn) }, iterator{} };
+        }
+    }
+
+    static auto count_of(const next_function_type& next_fn) -> std::size_t
+    {
+        const size_hint_t hint = next_fn.size_hint();
+        if (hint.upper && *hint.upper == hint.lower)
+        {
+            return hint.lower;
+        }
+        // Sequences known to be infinite are not advanced, as stages skipping by pulling would never return. Infinite
+        // sources skip in O(1) and report every requested element as skipped, hence the second check.
+        static constexpr std::size_t max = std::numeric_limits<std::size_t>::max();
+        const std::size_t count = !hint.upper && hint.lower == max ? max : next_fn.advance(max);
+        if (count == max)
+        {
+            throw std::length_error{ "sequence::count - the sequence is infinite" };
+        }
+        return count;
+    }
+
+    template <class Output>
+    static auto copy_to(const next_function_type& next_fn, Output out) -> Output
     {
-        return std::copy(begin(), end(), std::move(out));
+        detail::for_each_pushed(next_fn, [&](auto&& item) { *out++ = std::forward<decltype(item)>(item); });
+        return out;
     }
 
     template <class Seed, class BinaryFunc>
-    auto accumulate(Seed seed, BinaryFunc&& func) const -> Seed
+    static auto accumulate_with(const next_function_type& next_fn, Seed seed, BinaryFunc& func) -> Seed
     {
-        return std::accumulate(begin(), end(), std::move(seed), std::forward<BinaryFunc>(func));
+        detail::for_each_pushed(
+            next_fn, [&](auto&& item) { seed = std::invoke(func, std::move(seed), std::forward<decltype(item)>(item)); });
+        return seed;
     }
 };
 
+struct join_options
+{
+    // Both sides are partitioned into 2^radix_bits buckets by the hashes of their keys, each bucket of the build side
+    // getting its own hash table, and blocks of probe_block_size probe elements are probed bucket by bucket. This
+    // keeps the table being probed in cache when the build side would not fit there, at the price of the order of
+    // the results, which is only preserved within a bucket. 0 disables partitioning.
+    unsigned radix_bits = 0;
+    std::size_t probe_block_size = 1 << 16;
+    // hash_join makes the hash table of the probe side instead when both lengths are bounded and the probe side is
+    // the shorter one, provided both keys have the same type. The results keep the (build row, probe element)
+    // orientation but come in the order of the build side. left_join always builds from its first argument, as
+    // the probe elements without a match are found by streaming the probe side.
+    bool build_smaller = true;
+};
+
 namespace detail
 {
 
@@ -977,6 +4566,44 @@ struct iota_fn
         {
             return m_current++;
         }
+
+        auto next_batch(iteration_result_t<In>* out, std::size_t n) const -> std::size_t
+        {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                out[i] = m_current++;
+            }
+            return n;
+        }
+
+        auto push(sink_ref<In> sink) const -> bool
+        {
+            while (sink(m_current++))
+            {
+            }
+            return false;
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return size_hint_t::infinite();
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            if constexpr (std::is_integral_v<In>)
+            {
+                m_current += static_cast<In>(n);
+            }
+            else
+            {
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    ++m_current;
+                }
+            }
+            return n;
+        }
     };
 
     template <class T>
@@ -1002,6 +4629,77 @@ struct range_fn
             }
             return m_current++;
         }
+
+        auto next_batch(iteration_result_t<In>* out, std::size_t n) const -> std::size_t
+        {
+            std::size_t count = 0;
+            for (; count < n && m_current < m_upper; ++count)
+            {
+                out[count] = m_current++;
+            }
+            return count;
+        }
+
+        auto push(sink_ref<In> sink) const -> bool
+        {
+            while (m_current < m_upper)
+            {
+                if (!sink(m_current++))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            if constexpr (std::is_integral_v<In>)
+            {
+                return size_hint_t::exact(m_current < m_upper ? static_cast<std::size_t>(m_upper - m_current) : 0);
+            }
+            else
+            {
+                return size_hint_t{ m_current < m_upper ? 1u : 0u, {} };
+            }
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            if constexpr (std::is_integral_v<In>)
+            {
+                const std::size_t count = std::min(n, *size_hint().upper);
+                m_current += static_cast<In>(count);
+                return count;
+            }
+            else
+            {
+                std::size_t count = 0;
+                for (; count < n && m_current < m_upper; ++count)
+                {
+                    ++m_current;
+                }
+                return count;
+            }
+        }
+
+        auto split(std::size_t parts) const -> std::vector<next_function_t<In>>
+        {
+            std::vector<next_function_t<In>> result;
+            if constexpr (std::is_integral_v<In>)
+            {
+                const std::size_t count = *size_hint().upper;
+                parts = std::min(parts, count);
+                for (std::size_t i = 0; i < parts; ++i)
+                {
+                    const auto [begin, end] = detail::part_bounds(count, parts, i);
+                    result.emplace_back(
+                        next_function{ static_cast<In>(m_current + static_cast<In>(begin)),
+                                       static_cast<In>(m_current + static_cast<In>(end)) });
+                }
+            }
+            return result;
+        }
     };
 
     template <class T>
@@ -1053,20 +4751,7 @@ struct unfold_fn
 struct view_fn
 {
     template <class Iter, class Out>
-    struct next_function
-    {
-        mutable Iter m_iter;
-        Iter m_end;
-
-        auto operator()() const -> iteration_result_t<Out>
-        {
-            if (m_iter == m_end)
-            {
-                return {};
-            }
-            return *m_iter++;
-        }
-    };
+    using next_function = view_sequence<Iter, Out>;
 
     template <class Range, class Out = range_reference_t<Range>>
     auto operator()(Range&& range) const -> sequence<Out>
@@ -1100,19 +4785,75 @@ struct owning_fn
     {
         std::shared_ptr<Range> m_range;
         mutable Iter m_iter;
+        Iter m_end;
+
+        next_function(std::shared_ptr<Range> range)
+            : m_range(range)
+            , m_iter(std::begin(*m_range))
+            , m_end(std::end(*m_range))
+        {
+        }
 
-        next_function(std::shared_ptr<Range> range) : m_range(range), m_iter(std::begin(*m_range))
+        next_function(std::shared_ptr<Range> range, Iter begin, Iter end)
+            : m_range(std::move(range))
+            , m_iter(begin)
+            , m_end(end)
         {
         }
 
         auto operator()() const -> maybe<Out>
         {
-            if (m_iter == std::end(*m_range))
+            if (m_iter == m_end)
             {
                 return {};
             }
             return *m_iter++;
         }
+
+        auto push(sink_ref<Out> sink) const -> bool
+        {
+            const view_sequence<Iter, Out> view{ m_iter, m_end };
+            const bool result = view.push(sink);
+            m_iter = view.m_iter;
+            return result;
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return view_sequence<Iter, Out>{ m_iter, m_end }.size_hint();
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            const view_sequence<Iter, Out> view{ m_iter, m_end };
+            const std::size_t count = view.advance(n);
+            m_iter = view.m_iter;
+            return count;
+        }
+
+        auto contiguous() const -> maybe<span<std::decay_t<Out>>>
+        {
+            return view_sequence<Iter, Out>{ m_iter, m_end }.contiguous();
+        }
+
+        // The parts share the range.
+        auto split(std::size_t parts) const -> std::vector<next_function_t<Out>>
+        {
+            std::vector<next_function_t<Out>> result;
+            if constexpr (is_random_access_iterator<Iter>::value)
+            {
+                const auto count = static_cast<std::size_t>(std::distance(m_iter, m_end));
+                parts = std::min(parts, count);
+                for (std::size_t i = 0; i < parts; ++i)
+                {
+                    const auto [begin, end] = detail::part_bounds(count, parts, i);
+                    result.emplace_back(next_function{ m_range,
+                                                       m_iter + static_cast<iter_difference_t<Iter>>(begin),
+                                                       m_iter + static_cast<iter_difference_t<Iter>>(end) });
+                }
+            }
+            return result;
+        }
     };
 
     template <class Range, class Out = range_reference_t<Range>>
@@ -1151,6 +4892,18 @@ struct single_fn
             }
             return {};
         }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return size_hint_t::exact(m_init ? 1 : 0);
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            const bool skip = m_init && n > 0;
+            m_init = m_init && !skip;
+            return skip ? 1 : 0;
+        }
     };
 
     template <class T>
@@ -1171,6 +4924,16 @@ struct repeat_fn
         {
             return m_value;
         }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return size_hint_t::infinite();
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            return n;
+        }
     };
 
     template <class T>
@@ -1205,6 +4968,40 @@ struct concat_fn
             }
             return m_second();
         }
+
+        auto push(sink_ref<T> sink) const -> bool
+        {
+            if (!m_first_finished)
+            {
+                if (!m_first.push(sink))
+                {
+                    return false;
+                }
+                m_first_finished = true;
+            }
+            return m_second.push(sink);
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            std::size_t count = 0;
+            if (!m_first_finished)
+            {
+                count = m_first.advance(n);
+                m_first_finished = count < n;
+            }
+            return count < n ? count + m_second.advance(n - count) : count;
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            const size_hint_t first = m_first_finished ? size_hint_t::exact(0) : m_first.size_hint();
+            const size_hint_t second = m_second.size_hint();
+            return size_hint_t{ detail::saturating_add(first.lower, second.lower),
+                                first.upper && second.upper
+                                    ? maybe<std::size_t>{ detail::saturating_add(*first.upper, *second.upper) }
+                                    : maybe<std::size_t>{} };
+        }
     };
 
     template <class T0, class T1, class T2, class T3, class Out = std::common_type_t<T0, T1, T2, T3>>
@@ -1243,8 +5040,500 @@ struct concat_fn
     }
 };
 
+struct merge_sorted_fn
+{
+    // Tournament of the heads of the sources: every internal node of the tree holds the loser of the match played
+    // there, so replacing the winner replays only the matches on its path to the root, ie. ceil(log2 k) comparisons.
+    // Leaves are implicit - source i is node k + i - and exhausted sources lose every match. Ties are won by the
+    // source which comes first, so the merge is stable.
+    template <class T, class Compare>
+    struct next_function
+    {
+        std::vector<next_function_t<T>> m_sources;
+        Compare m_compare;
+        mutable std::vector<iteration_result_t<T>> m_heads = {};
+        mutable std::vector<std::size_t> m_losers = {};
+        mutable std::size_t m_winner = 0;
+        mutable bool m_started = false;
+
+        auto beats(std::size_t lhs, std::size_t rhs) const -> bool
+        {
+            if (!m_heads[lhs] || !m_heads[rhs])
+            {
+                return m_heads[lhs] ? true : m_heads[rhs] ? false : lhs < rhs;
+            }
+            return lhs < rhs ? !std::invoke(m_compare, *m_heads[rhs], *m_heads[lhs])
+                             : std::invoke(m_compare, *m_heads[lhs], *m_heads[rhs]);
+        }
+
+        auto build(std::size_t node) const -> std::size_t
+        {
+            const std::size_t k = m_sources.size();
+            if (node >= k)
+            {
+                return node - k;
+            }
+            const std::size_t lhs = build(2 * node);
+            const std::size_t rhs = build(2 * node + 1);
+            const bool lhs_wins = beats(lhs, rhs);
+            m_losers[node] = lhs_wins ? rhs : lhs;
+            return lhs_wins ? lhs : rhs;
+        }
+
+        void start() const
+        {
+            const std::size_t k = m_sources.size();
+            m_heads.reserve(k);
+            for (const next_function_t<T>& source : m_sources)
+            {
+                m_heads.push_back(source());
+            }
+            m_losers.resize(k);
+            m_winner = k > 1 ? build(1) : 0;
+            m_started = true;
+        }
+
+        void replay() const
+        {
+            m_heads[m_winner] = m_sources[m_winner]();
+            for (std::size_t node = (m_sources.size() + m_winner) / 2; node > 0; node /= 2)
+            {
+                if (beats(m_losers[node], m_winner))
+                {
+                    std::swap(m_losers[node], m_winner);
+                }
+            }
+        }
+
+        // The winner is refilled only on the following pull, so that the element yielded stays valid until then.
+        auto operator()() const -> iteration_result_t<T>
+        {
+            if (m_sources.empty())
+            {
+                return {};
+            }
+            if (!m_started)
+            {
+                start();
+            }
+            else
+            {
+                replay();
+            }
+            return std::move(m_heads[m_winner]);
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            size_hint_t result = size_hint_t::exact(0);
+            for (std::size_t i = 0; i < m_sources.size(); ++i)
+            {
+                const size_hint_t hint = m_sources[i].size_hint();
+                const std::size_t head = m_started && i != m_winner && m_heads[i] ? 1 : 0;
+                result = size_hint_t{ detail::saturating_add(result.lower, detail::saturating_add(hint.lower, head)),
+                                      result.upper && hint.upper
+                                          ? maybe<std::size_t>{ detail::saturating_add(
+                                              *result.upper, detail::saturating_add(*hint.upper, head)) }
+                                          : maybe<std::size_t>{} };
+            }
+            return result;
+        }
+    };
+
+    template <class Head, class... Tail>
+    using merged_type = std::conditional_t<(std::is_same_v<Head, Tail> && ...), Head, std::common_type_t<Head, Tail...>>;
+
+    // Lazily merges sequences sorted with respect to compare into one sorted sequence.
+    template <class T, class Compare = std::less<>>
+    auto operator()(std::vector<sequence<T>> sequences, Compare compare = {}) const -> sequence<T>
+    {
+        std::vector<next_function_t<T>> sources;
+        sources.reserve(sequences.size());
+        for (sequence<T>& seq : sequences)
+        {
+            sources.push_back(std::move(seq).get_next_function());
+        }
+        return sequence<T>{ next_function<T, Compare>{ std::move(sources), std::move(compare) } };
+    }
+
+    // Called as merge_sorted(s0, s1, ..., sn) or merge_sorted(s0, s1, ..., sn, compare).
+    template <class T, class... Tail>
+    auto operator()(const sequence<T>& head, const Tail&... tail) const
+    {
+        if constexpr ((is_sequence<Tail>::value && ...))
+        {
+            return merge_all(std::less<>{}, head, tail...);
+        }
+        else
+        {
+            return merge_args(std::forward_as_tuple(head, tail...), std::make_index_sequence<sizeof...(Tail)>{});
+        }
+    }
+
+private:
+    template <class Compare, class T, class... Tail>
+    auto merge_all(Compare compare, const sequence<T>& head, const Tail&... tail) const
+        -> sequence<merged_type<T, typename Tail::reference...>>
+    {
+        using out_type = merged_type<T, typename Tail::reference...>;
+        return (*this)(
+            std::vector<sequence<out_type>>{ sequence<out_type>{ head }, sequence<out_type>{ tail }... },
+            std::move(compare));
+    }
+
+    template <class Tuple, std::size_t... I>
+    auto merge_args(const Tuple& args, std::index_sequence<I...>) const
+    {
+        return merge_all(std::get<sizeof...(I)>(args), std::get<I>(args)...);
+    }
+};
+
+// Build side of a hash join, split into buckets. Every entry of the table of a bucket holds the first row of its key,
+// so a lookup touches no other memory unless the key has more rows; those are chained in build order in an overflow
+// array. With several buckets the rows are staged per bucket first and the tables are made bucket by bucket in
+// finish, so that each table stays in cache while it is filled.
+template <class Key, class Row>
+class join_table
+{
+public:
+    static constexpr std::size_t end_of_chain = std::numeric_limits<std::size_t>::max();
+
+    struct chain
+    {
+        Row m_first;
+        std::size_t m_more = end_of_chain;
+        std::size_t m_last = end_of_chain;
+
+        explicit chain(Row first) : m_first(std::move(first))
+        {
+        }
+    };
+
+    explicit join_table(unsigned radix_bits) : m_buckets(std::size_t{ 1 } << radix_bits), m_radix_bits(radix_bits)
+    {
+    }
+
+    // Low bits of the splitmix64 finalizer; the tables use the high bits of the Fibonacci hash, which they keep spread.
+    auto bucket_of(const Key& key) const -> std::size_t
+    {
+        if (m_radix_bits == 0)
+        {
+            return 0;
+        }
+        auto x = static_cast<std::uint64_t>(std::hash<Key>{}(key));
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return static_cast<std::size_t>(x ^ (x >> 31)) & (m_buckets.size() - 1);
+    }
+
+    auto bucket_count() const -> std::size_t
+    {
+        return m_buckets.size();
+    }
+
+    void reserve(std::size_t row_count)
+    {
+        if (m_radix_bits == 0)
+        {
+            m_buckets.front().m_chains.reserve(row_count);
+        }
+    }
+
+    void add(Key key, Row row)
+    {
+        bucket& b = m_buckets[bucket_of(key)];
+        if (m_radix_bits == 0)
+        {
+            b.insert(std::move(key), std::move(row));
+            return;
+        }
+        b.m_staged.emplace_back(std::move(key), std::move(row));
+    }
+
+    void finish()
+    {
+        for (bucket& b : m_buckets)
+        {
+            b.m_chains.reserve(b.m_staged.size());
+            for (auto& [key, row] : b.m_staged)
+            {
+                b.insert(std::move(key), std::move(row));
+            }
+            b.m_staged = {};
+        }
+    }
+
+    auto find(std::size_t bucket_index, const Key& key) const -> const chain*
+    {
+        const bucket& b = m_buckets[bucket_index];
+        const auto it = b.m_chains.find(key);
+        return it != b.m_chains.end() ? &it->second : nullptr;
+    }
+
+    auto overflow_row(std::size_t bucket_index, std::size_t index) const -> const Row&
+    {
+        return m_buckets[bucket_index].m_overflow[index];
+    }
+
+    auto overflow_next(std::size_t bucket_index, std::size_t index) const -> std::size_t
+    {
+        return m_buckets[bucket_index].m_overflow_next[index];
+    }
+
+private:
+    struct bucket
+    {
+        flat_hash_map<Key, chain> m_chains = {};
+        std::vector<Row> m_overflow = {};
+        std::vector<std::size_t> m_overflow_next = {};
+        std::vector<std::pair<Key, Row>> m_staged = {};
+
+        void insert(Key key, Row row)
+        {
+            const auto [it, inserted] = m_chains.try_emplace(std::move(key), std::move(row));
+            if (inserted)
+            {
+                return;
+            }
+            chain& c = it->second;
+            const std::size_t index = m_overflow.size();
+            m_overflow.push_back(std::move(row));
+            m_overflow_next.push_back(end_of_chain);
+            (c.m_last == end_of_chain ? c.m_more : m_overflow_next[c.m_last]) = index;
+            c.m_last = index;
+        }
+    };
+
+    std::vector<bucket> m_buckets;
+    unsigned m_radix_bits;
+};
+
+template <bool Left>
+struct hash_join_fn
+{
+    template <class B, class P, class BuildKey, class ProbeKey>
+    struct next_function
+    {
+        using build_type = std::decay_t<B>;
+        using probe_type = std::decay_t<P>;
+        using key_type = std::decay_t<std::invoke_result_t<BuildKey&, const build_type&>>;
+        using table_type = join_table<key_type, build_type>;
+        using build_result = std::conditional_t<Left, maybe<build_type>, build_type>;
+        using result_type = std::tuple<build_result, probe_type>;
+
+        next_function_t<B> m_build;
+        next_function_t<P> m_probe;
+        BuildKey m_build_key;
+        ProbeKey m_probe_key;
+        join_options m_options;
+        // Immutable once built, hence shared by the copies.
+        mutable std::shared_ptr<const table_type> m_table = {};
+        // Current block of probe elements, with their buckets and the rows of their keys, visited in the order of
+        // m_order when partitioning. m_row is the next row of the current element, first_row before its first one.
+        mutable std::vector<iteration_result_t<P>> m_block = {};
+        mutable std::vector<key_type> m_keys = {};
+        mutable std::vector<std::size_t> m_buckets = {};
+        mutable std::vector<const typename table_type::chain*> m_found = {};
+        mutable std::vector<std::size_t> m_order = {};
+        mutable std::size_t m_count = 0;
+        mutable std::size_t m_pos = 0;
+        mutable std::size_t m_row = first_row;
+
+        static constexpr std::size_t first_row = table_type::end_of_chain - 1;
+
+        auto operator()() const -> iteration_result_t<result_type>
+        {
+            while (true)
+            {
+                if (m_pos == m_count && !refill())
+                {
+                    return {};
+                }
+                const std::size_t index = m_order.empty() ? m_pos : m_order[m_pos];
+                const typename table_type::chain* chain = m_found[index];
+                if (!chain)
+                {
+                    ++m_pos;
+                    if constexpr (Left)
+                    {
+                        return result_type{ build_result{}, probe_type(*std::move(m_block[index])) };
+                    }
+                    continue;
+                }
+                const build_type& row
+                    = m_row == first_row ? chain->m_first : m_table->overflow_row(m_buckets[index], m_row);
+                m_row = m_row == first_row ? chain->m_more : m_table->overflow_next(m_buckets[index], m_row);
+                if (m_row != table_type::end_of_chain)
+                {
+                    return result_type{ build_result{ row }, probe_type(*m_block[index]) };
+                }
+                m_row = first_row;
+                ++m_pos;
+                return result_type{ build_result{ row }, probe_type(*std::move(m_block[index])) };
+            }
+        }
+
+        auto push(sink_ref<result_type> sink) const -> bool
+        {
+            // Finishes the rows of the current probe element, if a pull stopped in the middle of them.
+            while (m_row != first_row)
+            {
+                if (!sink(*(*this)()))
+                {
+                    return false;
+                }
+            }
+            while (m_pos < m_count || refill())
+            {
+                const std::size_t index = m_order.empty() ? m_pos : m_order[m_pos];
+                const typename table_type::chain* chain = m_found[index];
+                ++m_pos;
+                if (!chain)
+                {
+                    if constexpr (Left)
+                    {
+                        if (!sink(result_type{ build_result{}, probe_type(*std::move(m_block[index])) }))
+                        {
+                            return false;
+                        }
+                    }
+                    continue;
+                }
+                std::size_t row = first_row;
+                do
+                {
+                    const build_type& value
+                        = row == first_row ? chain->m_first : m_table->overflow_row(m_buckets[index], row);
+                    row = row == first_row ? chain->m_more : m_table->overflow_next(m_buckets[index], row);
+                    const bool last = row == table_type::end_of_chain;
+                    if (!sink(result_type{ build_result{ value },
+                                           last ? probe_type(*std::move(m_block[index])) : probe_type(*m_block[index]) }))
+                    {
+                        if (!last)
+                        {
+                            --m_pos;
+                            m_row = row;
+                        }
+                        return false;
+                    }
+                } while (row != table_type::end_of_chain);
+            }
+            return true;
+        }
+
+        void build() const
+        {
+            auto table = std::make_shared<table_type>(m_options.radix_bits);
+            const size_hint_t hint = m_build.size_hint();
+            table->reserve(hint.upper ? hint.lower : 0);
+            detail::for_each_pushed(
+                m_build,
+                [&](auto&& row)
+                {
+                    key_type key = std::invoke(m_build_key, std::as_const(row));
+                    table->add(std::move(key), build_type(std::forward<decltype(row)>(row)));
+                });
+            table->finish();
+            m_table = std::move(table);
+        }
+
+        // Reads the next block of the probe side, sorts it by bucket when partitioning, and looks all its keys up
+        // in a row: the lookups are independent, so their cache misses overlap.
+        auto refill() const -> bool
+        {
+            if (!m_table)
+            {
+                build();
+            }
+            const std::size_t size = m_options.radix_bits == 0 ? default_batch_size : m_options.probe_block_size;
+            m_block.resize(std::max<std::size_t>(size, 1));
+            m_count = m_probe.next_batch(m_block.data(), m_block.size());
+            m_pos = 0;
+            m_keys.clear();
+            m_buckets.clear();
+            for (std::size_t i = 0; i < m_count; ++i)
+            {
+                m_keys.push_back(key_type(std::invoke(m_probe_key, std::as_const(*m_block[i]))));
+                m_buckets.push_back(m_table->bucket_of(m_keys.back()));
+            }
+            if (m_options.radix_bits != 0)
+            {
+                std::vector<std::size_t> offsets(m_table->bucket_count() + 1, 0);
+                for (std::size_t i = 0; i < m_count; ++i)
+                {
+                    ++offsets[m_buckets[i] + 1];
+                }
+                std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+                m_order.resize(m_count);
+                for (std::size_t i = 0; i < m_count; ++i)
+                {
+                    m_order[offsets[m_buckets[i]]++] = i;
+                }
+            }
+            m_found.resize(m_count);
+            for (std::size_t pos = 0; pos < m_count; ++pos)
+            {
+                const std::size_t index = m_order.empty() ? pos : m_order[pos];
+                m_found[index] = m_table->find(m_buckets[index], m_keys[index]);
+            }
+            return m_count > 0;
+        }
+    };
+
+    // Yields (build row, probe element) for every pair of elements with equal keys; left_join also yields
+    // (none, probe element) for the probe elements without a match. The hash table of one side is made on the first
+    // pull and the other side is streamed through it; see join_options::build_smaller.
+    template <class B, class P, class BuildKey, class ProbeKey>
+    auto operator()(
+        const sequence<B>& build,
+        const sequence<P>& probe,
+        BuildKey build_key,
+        ProbeKey probe_key,
+        const join_options& options = {}) const
+        -> sequence<typename next_function<B, P, BuildKey, ProbeKey>::result_type>
+    {
+        using forward = next_function<B, P, BuildKey, ProbeKey>;
+        using swapped = next_function<P, B, ProbeKey, BuildKey>;
+        using result_type = typename forward::result_type;
+        static_assert(!is_transient<std::decay_t<B>>::value, "transient elements cannot be joined");
+        static_assert(!is_transient<std::decay_t<P>>::value, "transient elements cannot be joined");
+        if (options.radix_bits > 16)
+        {
+            throw std::invalid_argument{ "hash_join: radix_bits must be at most 16" };
+        }
+        if constexpr (!Left && std::is_same_v<typename forward::key_type, typename swapped::key_type>)
+        {
+            const maybe<std::size_t> build_size = build.size_hint().upper;
+            const maybe<std::size_t> probe_size = probe.size_hint().upper;
+            if (options.build_smaller && build_size && probe_size && *probe_size < *build_size)
+            {
+                return sequence<typename swapped::result_type>{ swapped{ probe.get_next_function(),
+                                                                         build.get_next_function(),
+                                                                         std::move(probe_key),
+                                                                         std::move(build_key),
+                                                                         options } }
+                    .transform(
+                        [](typename swapped::result_type&& item)
+                        { return result_type{ std::get<1>(std::move(item)), std::get<0>(std::move(item)) }; });
+            }
+        }
+        return sequence<result_type>{ forward{
+            build.get_next_function(), probe.get_next_function(), std::move(build_key), std::move(probe_key), options } };
+    }
+};
+
 struct zip_fn
 {
+    static auto zip_size_hint(std::initializer_list<size_hint_t> hints) -> size_hint_t
+    {
+        size_hint_t result = size_hint_t::infinite();
+        for (const size_hint_t& hint : hints)
+        {
+            result = size_hint_t{ std::min(result.lower, hint.lower), detail::min_upper(result.upper, hint.upper) };
+        }
+        return result;
+    }
+
     template <class In0, class In1 = void, class In2 = void, class In3 = void>
     struct next_function;
 
@@ -1268,6 +5557,16 @@ struct zip_fn
             }
             return {};
         }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return zip_size_hint({ m_next0.size_hint(), m_next1.size_hint(), m_next2.size_hint(), m_next3.size_hint() });
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            return std::min({ m_next0.advance(n), m_next1.advance(n), m_next2.advance(n), m_next3.advance(n) });
+        }
     };
 
     template <class In0, class In1, class In2>
@@ -1288,6 +5587,16 @@ struct zip_fn
             }
             return {};
         }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return zip_size_hint({ m_next0.size_hint(), m_next1.size_hint(), m_next2.size_hint() });
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            return std::min({ m_next0.advance(n), m_next1.advance(n), m_next2.advance(n) });
+        }
     };
 
     template <class In0, class In1>
@@ -1306,6 +5615,16 @@ struct zip_fn
             }
             return {};
         }
+
+        auto size_hint() const -> size_hint_t
+        {
+            return zip_size_hint({ m_next0.size_hint(), m_next1.size_hint() });
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            return std::min({ m_next0.advance(n), m_next1.advance(n) });
+        }
     };
 
     template <class T0, class T1, class T2, class T3, class Out = std::tuple<T0, T1, T2, T3>>
@@ -1389,7 +5708,7 @@ struct get_lines_fn
                 case std::streambuf::traits_type::eof():
                     if (str.empty())
                     {
-                        is.setstate(std::ios::eofbit);
+                        is.setstate(std::ios::eofbit | std::ios::failbit);
                     }
                     return is;
                 default: str += (char)c;
@@ -1427,8 +5746,11 @@ static constexpr inline auto owning = detail::owning_fn{};
 static constexpr inline auto repeat = detail::repeat_fn{};
 static constexpr inline auto single = detail::single_fn{};
 static constexpr inline auto concat = detail::concat_fn{};
+static constexpr inline auto merge_sorted = detail::merge_sorted_fn{};
 static constexpr inline auto vec = detail::vec_fn{};
 static constexpr inline auto zip = detail::zip_fn{};
+static constexpr inline auto hash_join = detail::hash_join_fn<false>{};
+static constexpr inline auto left_join = detail::hash_join_fn<true>{};
 static constexpr inline auto init = detail::init_fn{};
 static constexpr inline auto init_infinite = detail::init_infinite_fn{};
 static constexpr inline auto get_lines = detail::get_lines_fn{};
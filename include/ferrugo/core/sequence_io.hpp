@@ -0,0 +1,595 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <ferrugo/core/channel.hpp>
+#include <ferrugo/core/sequence.hpp>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ferrugo
+{
+namespace core
+{
+
+namespace detail
+{
+
+class mapped_file
+{
+public:
+    explicit mapped_file(const std::string& path) : m_data(nullptr), m_size(0)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::system_error{ errno, std::generic_category(), path };
+        }
+
+        struct stat st = {};
+        if (::fstat(fd, &st) != 0)
+        {
+            const int error = errno;
+            ::close(fd);
+            throw std::system_error{ error, std::generic_category(), path };
+        }
+
+        m_size = static_cast<std::size_t>(st.st_size);
+        if (m_size > 0)
+        {
+            void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                const int error = errno;
+                ::close(fd);
+                throw std::system_error{ error, std::generic_category(), path };
+            }
+            ::madvise(data, m_size, MADV_SEQUENTIAL);
+            m_data = static_cast<const char*>(data);
+        }
+        ::close(fd);
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    ~mapped_file()
+    {
+        if (m_data)
+        {
+            ::munmap(const_cast<char*>(m_data), m_size);
+        }
+    }
+
+    auto begin() const -> const char*
+    {
+        return m_data;
+    }
+
+    auto end() const -> const char*
+    {
+        return m_data + m_size;
+    }
+
+private:
+    const char* m_data;
+    std::size_t m_size;
+};
+
+inline auto find_char(const char* b, const char* e, char ch) -> const char*
+{
+    const void* res = std::memchr(b, ch, static_cast<std::size_t>(e - b));
+    return res ? static_cast<const char*>(res) : e;
+}
+
+struct mmap_lines_fn
+{
+    // Splits the mapped file using the same rules as get_lines: "\n", "\r\n" and a lone "\r" end a line, and the last
+    // line is yielded only if not empty. Line ends are found with memchr, which is vectorised by the C library.
+    struct next_function
+    {
+        std::shared_ptr<const mapped_file> m_file;
+        mutable const char* m_pos;
+        mutable const char* m_next_lf;
+        mutable const char* m_next_cr;
+
+        explicit next_function(std::shared_ptr<const mapped_file> file)
+            : m_file(std::move(file))
+            , m_pos(m_file->begin())
+            , m_next_lf(m_pos != m_file->end() ? find_char(m_pos, m_file->end(), '\n') : m_pos)
+            , m_next_cr(m_pos != m_file->end() ? find_char(m_pos, m_file->end(), '\r') : m_pos)
+        {
+        }
+
+        auto operator()() const -> iteration_result_t<std::string_view>
+        {
+            const char* const end = m_file->end();
+            if (m_pos == end)
+            {
+                return {};
+            }
+
+            if (m_next_lf < m_pos)
+            {
+                m_next_lf = find_char(m_pos, end, '\n');
+            }
+            if (m_next_cr < m_pos)
+            {
+                m_next_cr = find_char(m_pos, end, '\r');
+            }
+
+            const char* const line_end = std::min(m_next_lf, m_next_cr);
+            const std::string_view line{ m_pos, static_cast<std::size_t>(line_end - m_pos) };
+            if (line_end == end)
+            {
+                m_pos = end;
+            }
+            else if (*line_end == '\r' && line_end + 1 != end && line_end[1] == '\n')
+            {
+                m_pos = line_end + 2;
+            }
+            else
+            {
+                m_pos = line_end + 1;
+            }
+            return line;
+        }
+
+        auto size_hint() const -> size_hint_t
+        {
+            const auto remaining = static_cast<std::size_t>(m_file->end() - m_pos);
+            return size_hint_t{ remaining > 0 ? 1u : 0u, remaining };
+        }
+    };
+
+    // The yielded views point into the mapping, which stays alive as long as any copy of the sequence does.
+    auto operator()(const std::string& path) const -> sequence<std::string_view>
+    {
+        return sequence<std::string_view>{ next_function{ std::make_shared<const mapped_file>(path) } };
+    }
+};
+
+}  // namespace detail
+
+struct record_options
+{
+    // Size of the blocks read at once, rounded down to a whole number of records (at least one).
+    std::size_t block_size = std::size_t{ 1 } << 20;
+    // Reads the next block on a separate thread while the current one is consumed.
+    bool double_buffered = false;
+};
+
+namespace detail
+{
+
+// Reads up to n bytes; fewer only at the end of the input.
+using byte_source = std::function<std::size_t(char*, std::size_t)>;
+
+inline auto istream_byte_source(std::istream& is) -> byte_source
+{
+    return [&is](char* out, std::size_t n) -> std::size_t
+    {
+        is.read(out, static_cast<std::streamsize>(n));
+        if (is.bad())
+        {
+            throw std::runtime_error{ "read_records: stream error" };
+        }
+        return static_cast<std::size_t>(is.gcount());
+    };
+}
+
+inline auto fd_byte_source(int fd) -> byte_source
+{
+    return [fd](char* out, std::size_t n) -> std::size_t
+    {
+        std::size_t total = 0;
+        while (total < n)
+        {
+            const ::ssize_t count = ::read(fd, out + total, n - total);
+            if (count < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::system_error{ errno, std::generic_category(), "read_records" };
+            }
+            if (count == 0)
+            {
+                break;
+            }
+            total += static_cast<std::size_t>(count);
+        }
+        return total;
+    };
+}
+
+// Reads the input in blocks of whole records into buffers aligned for T. In the double buffered mode, a worker
+// thread fills one buffer while the consumer reads the other; buffers travel between them through two channels. The
+// worker is started by the first pull, so an input which is never iterated is never read. Destruction closes the
+// channels, which makes the worker stop at its next push, and joins it; a read already in progress is waited for, so
+// on a pipe it blocks until the writer produces data or closes its end.
+template <class T>
+class record_blocks
+{
+public:
+    record_blocks(byte_source source, const record_options& options)
+        : m_source(std::move(source))
+        , m_records_per_block(std::max<std::size_t>(1, options.block_size / sizeof(T)))
+    {
+        if (!options.double_buffered)
+        {
+            m_current.resize(m_records_per_block);
+            return;
+        }
+        m_double_buffered = true;
+        m_free.push(buffer(m_records_per_block));
+        m_free.push(buffer(m_records_per_block));
+    }
+
+    record_blocks(const record_blocks&) = delete;
+    record_blocks& operator=(const record_blocks&) = delete;
+
+    ~record_blocks()
+    {
+        if (m_worker.joinable())
+        {
+            m_free.close();
+            m_filled.close();
+            m_worker.join();
+        }
+    }
+
+    // The next block; empty at the end of the input. The previous block is invalidated.
+    auto next() -> span<T>
+    {
+        if (!m_double_buffered)
+        {
+            if (m_done)
+            {
+                return {};
+            }
+            const std::size_t count = fill(m_current);
+            m_done = count < m_current.size();
+            return as_span(m_current, count);
+        }
+        if (!m_worker.joinable())
+        {
+            m_worker = std::thread([this]() { run(); });
+        }
+        if (!m_current.empty())
+        {
+            m_free.push(std::move(m_current));
+            m_current = {};
+        }
+        std::optional<std::pair<buffer, std::size_t>> filled = m_filled.pop();
+        if (!filled)
+        {
+            if (m_error)
+            {
+                std::rethrow_exception(m_error);
+            }
+            return {};
+        }
+        m_current = std::move(filled->first);
+        return as_span(m_current, filled->second);
+    }
+
+private:
+    struct alignas(T) storage
+    {
+        char bytes[sizeof(T)];
+    };
+
+    using buffer = std::vector<storage>;
+
+    static auto as_span(const buffer& buf, std::size_t count) -> span<T>
+    {
+        return span<T>{ reinterpret_cast<const T*>(buf.data()), static_cast<std::ptrdiff_t>(count) };
+    }
+
+    // Number of records read into buf; a record cut by the end of the input is an error.
+    auto fill(buffer& buf) -> std::size_t
+    {
+        const std::size_t bytes = m_source(reinterpret_cast<char*>(buf.data()), buf.size() * sizeof(T));
+        if (bytes % sizeof(T) != 0)
+        {
+            throw std::runtime_error{ "read_records: truncated record at the end of the input" };
+        }
+        return bytes / sizeof(T);
+    }
+
+    void run()
+    {
+        try
+        {
+            while (std::optional<buffer> buf = m_free.pop())
+            {
+                const std::size_t count = fill(*buf);
+                const bool last = count < buf->size();
+                if (count > 0)
+                {
+                    m_filled.push(std::pair<buffer, std::size_t>{ std::move(*buf), count });
+                }
+                if (last)
+                {
+                    break;
+                }
+            }
+        }
+        catch (...)
+        {
+            // A push to a channel closed by the consumer is not an error.
+            if (!m_filled.is_closed())
+            {
+                m_error = std::current_exception();
+            }
+        }
+        m_filled.close();
+    }
+
+    byte_source m_source;
+    std::size_t m_records_per_block;
+    buffer m_current = {};
+    bool m_double_buffered = false;
+    bool m_done = false;
+    channel<buffer> m_free{ 2 };
+    channel<std::pair<buffer, std::size_t>> m_filled{ 2 };
+    std::exception_ptr m_error = {};
+    std::thread m_worker = {};
+};
+
+template <class T>
+struct read_record_blocks_fn
+{
+    static_assert(std::is_trivially_copyable_v<T>, "records must be trivially copyable");
+
+    struct next_function
+    {
+        std::shared_ptr<record_blocks<T>> m_blocks;
+
+        auto operator()() const -> iteration_result_t<span<T>>
+        {
+            const span<T> block = m_blocks->next();
+            return !block.empty() ? iteration_result_t<span<T>>{ block } : iteration_result_t<span<T>>{};
+        }
+    };
+
+    // Zero-copy access: every block is valid until the next one is pulled. Copies of the sequence share the input.
+    auto operator()(std::istream& is, const record_options& options = {}) const -> sequence<span<T>>
+    {
+        return make(istream_byte_source(is), options);
+    }
+
+    auto operator()(int fd, const record_options& options = {}) const -> sequence<span<T>>
+    {
+        return make(fd_byte_source(fd), options);
+    }
+
+    static auto make(byte_source source, const record_options& options) -> sequence<span<T>>
+    {
+        return sequence<span<T>>{ next_function{ std::make_shared<record_blocks<T>>(std::move(source), options) } };
+    }
+};
+
+template <class T>
+struct read_records_fn
+{
+    static_assert(std::is_trivially_copyable_v<T>, "records must be trivially copyable");
+
+    // Records are copied out of the current block, so they stay valid after the block is replaced.
+    struct next_function
+    {
+        std::shared_ptr<record_blocks<T>> m_blocks;
+        mutable const T* m_pos = nullptr;
+        mutable const T* m_end = nullptr;
+
+        auto refill() const -> bool
+        {
+            if (m_pos == m_end)
+            {
+                const span<T> block = m_blocks->next();
+                m_pos = block.begin();
+                m_end = block.end();
+            }
+            return m_pos != m_end;
+        }
+
+        auto operator()() const -> iteration_result_t<T>
+        {
+            if (!refill())
+            {
+                return {};
+            }
+            return *m_pos++;
+        }
+
+        auto next_batch(iteration_result_t<T>* out, std::size_t n) const -> std::size_t
+        {
+            if (!refill())
+            {
+                return 0;
+            }
+            const std::size_t count = std::min(n, static_cast<std::size_t>(m_end - m_pos));
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                out[i] = m_pos[i];
+            }
+            m_pos += count;
+            return count;
+        }
+
+        auto advance(std::size_t n) const -> std::size_t
+        {
+            std::size_t skipped = 0;
+            while (skipped < n && refill())
+            {
+                const std::size_t count = std::min(n - skipped, static_cast<std::size_t>(m_end - m_pos));
+                m_pos += count;
+                skipped += count;
+            }
+            return skipped;
+        }
+
+        auto push(sink_ref<T> sink) const -> bool
+        {
+            while (refill())
+            {
+                while (m_pos != m_end)
+                {
+                    if (!sink(T(*m_pos++)))
+                    {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+    };
+
+    auto operator()(std::istream& is, const record_options& options = {}) const -> sequence<T>
+    {
+        return make(istream_byte_source(is), options);
+    }
+
+    auto operator()(int fd, const record_options& options = {}) const -> sequence<T>
+    {
+        return make(fd_byte_source(fd), options);
+    }
+
+    static auto make(byte_source source, const record_options& options) -> sequence<T>
+    {
+        return sequence<T>{ next_function{ std::make_shared<record_blocks<T>>(std::move(source), options) } };
+    }
+};
+
+struct csv_records_fn
+{
+    // A quoted field may contain line breaks, which are kept as they are, e.g. "\r\n"; outside of quotes "\n",
+    // "\r\n" and "\r" end a record.
+    struct next_function
+    {
+        std::istream& m_is;
+        char m_delim;
+        char m_quote;
+        mutable field_splitter m_splitter;
+        mutable std::string m_record = {};
+
+        auto operator()() const -> iteration_result_t<span<std::string_view>>
+        {
+            if (!get_record(m_is, m_record, m_delim, m_quote))
+            {
+                return {};
+            }
+            if (!m_splitter.split(m_record))
+            {
+                throw std::runtime_error{ "csv_records: unterminated quoted field" };
+            }
+            return m_splitter.fields();
+        }
+    };
+
+    // Reads a record up to the first line break outside of a quoted field; false at the end of the input.
+    static auto get_record(std::istream& is, std::string& record, char delim, char quote) -> bool
+    {
+        enum class state
+        {
+            field_start,
+            unquoted,
+            quoted,
+            quote_in_quoted
+        };
+
+        record.clear();
+        const std::istream::sentry se(is, true);
+        if (!se)
+        {
+            return false;
+        }
+        std::streambuf* sb = is.rdbuf();
+        state st = state::field_start;
+        while (true)
+        {
+            const int c = sb->sbumpc();
+            if (c == std::streambuf::traits_type::eof())
+            {
+                if (st == state::quoted)
+                {
+                    throw std::runtime_error{ "csv_records: unterminated quoted field" };
+                }
+                if (record.empty())
+                {
+                    is.setstate(std::ios::eofbit | std::ios::failbit);
+                    return false;
+                }
+                return true;
+            }
+            const char ch = static_cast<char>(c);
+            if (st == state::quoted)
+            {
+                st = ch == quote ? state::quote_in_quoted : state::quoted;
+            }
+            else if (ch == '\n' || ch == '\r')
+            {
+                if (ch == '\r' && sb->sgetc() == '\n')
+                {
+                    sb->sbumpc();
+                }
+                return true;
+            }
+            else if (ch == delim)
+            {
+                st = state::field_start;
+            }
+            else if (ch == quote && st != state::unquoted)
+            {
+                st = state::quoted;
+            }
+            else
+            {
+                st = state::unquoted;
+            }
+            record += ch;
+        }
+    }
+
+    // Yields the fields of every record, valid until the next one is pulled; see also parse_row.
+    auto operator()(std::istream& is, char delim = ',', char quote = '"') const -> sequence<span<std::string_view>>
+    {
+        return sequence<span<std::string_view>>{ next_function{ is, delim, quote, field_splitter{ delim, quote } } };
+    }
+};
+
+}  // namespace detail
+
+static constexpr inline auto mmap_lines = detail::mmap_lines_fn{};
+static constexpr inline auto csv_records = detail::csv_records_fn{};
+
+// Sources of fixed-size binary records (trivially copyable T in the native layout) read from a stream or a file
+// descriptor, which is not closed. The input is read in large blocks; read_records yields copies of the records,
+// read_record_blocks the blocks themselves.
+template <class T>
+static constexpr inline auto read_records = detail::read_records_fn<T>{};
+
+template <class T>
+static constexpr inline auto read_record_blocks = detail::read_record_blocks_fn<T>{};
+
+}  // namespace core
+}  // namespace ferrugo
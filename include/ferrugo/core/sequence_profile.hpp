@@ -0,0 +1,309 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ferrugo
+{
+namespace core
+{
+
+// Statistics of a profile point, i.e. of the stages between it and the nearest profile point upstream.
+struct profile_stats
+{
+    std::string name;
+    std::uint64_t calls;
+    // Elements yielded by the nearest profile point upstream; 0 if there is none.
+    std::uint64_t elements_in;
+    std::uint64_t elements_out;
+    // Time spent pulling from the profile point, with and without the time spent in profile points upstream.
+    std::chrono::nanoseconds inclusive_time;
+    std::chrono::nanoseconds exclusive_time;
+
+    auto pass_ratio() const -> double
+    {
+        return elements_in > 0 ? static_cast<double>(elements_out) / static_cast<double>(elements_in) : 1.0;
+    }
+};
+
+namespace detail
+{
+
+struct profile_record
+{
+    std::string m_name;
+    std::atomic<std::uint64_t> m_calls{ 0 };
+    std::atomic<std::uint64_t> m_elements_in{ 0 };
+    std::atomic<std::uint64_t> m_elements_out{ 0 };
+    std::atomic<std::int64_t> m_inclusive_ns{ 0 };
+    std::atomic<std::int64_t> m_exclusive_ns{ 0 };
+
+    explicit profile_record(std::string name) : m_name(std::move(name))
+    {
+    }
+
+    auto stats() const -> profile_stats
+    {
+        return profile_stats{ m_name,
+                              m_calls.load(std::memory_order_relaxed),
+                              m_elements_in.load(std::memory_order_relaxed),
+                              m_elements_out.load(std::memory_order_relaxed),
+                              std::chrono::nanoseconds{ m_inclusive_ns.load(std::memory_order_relaxed) },
+                              std::chrono::nanoseconds{ m_exclusive_ns.load(std::memory_order_relaxed) } };
+    }
+
+    void reset()
+    {
+        m_calls = 0;
+        m_elements_in = 0;
+        m_elements_out = 0;
+        m_inclusive_ns = 0;
+        m_exclusive_ns = 0;
+    }
+};
+
+// Records of all the profile points, in the order of their creation. Profile points of the same name share a record.
+class profile_registry
+{
+public:
+    static auto instance() -> profile_registry&
+    {
+        static profile_registry registry;
+        return registry;
+    }
+
+    auto get(const std::string& name) -> std::shared_ptr<profile_record>
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        const auto found = std::find_if(
+            m_records.begin(), m_records.end(), [&](const auto& record) { return record->m_name == name; });
+        if (found != m_records.end())
+        {
+            return *found;
+        }
+        return m_records.emplace_back(std::make_shared<profile_record>(name));
+    }
+
+    auto stats() const -> std::vector<profile_stats>
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        std::vector<profile_stats> result;
+        for (const auto& record : m_records)
+        {
+            result.push_back(record->stats());
+        }
+        return result;
+    }
+
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        for (const auto& record : m_records)
+        {
+            record->reset();
+        }
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::vector<std::shared_ptr<profile_record>> m_records;
+};
+
+// Pulls in progress on the current thread form a stack of scopes, innermost being the most upstream one. A scope
+// accumulates the time spent in and the elements yielded by the scope directly nested in it.
+struct profile_scope
+{
+    profile_scope* m_parent;
+    std::int64_t m_child_ns = 0;
+    std::uint64_t m_child_elements = 0;
+
+    static auto current() -> profile_scope*&
+    {
+        static thread_local profile_scope* scope = nullptr;
+        return scope;
+    }
+};
+
+inline auto profiling_flag() -> std::atomic<bool>&
+{
+    static std::atomic<bool> flag{ false };
+    return flag;
+}
+
+inline auto elapsed_ns(std::chrono::steady_clock::time_point start) -> std::int64_t
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Accounts a call of the profile point which took elapsed ns and produced count elements, and which was made in scope.
+inline void account_profile(profile_record& record, const profile_scope& scope, std::int64_t elapsed, std::size_t count)
+{
+    record.m_calls.fetch_add(1, std::memory_order_relaxed);
+    record.m_elements_in.fetch_add(scope.m_child_elements, std::memory_order_relaxed);
+    record.m_elements_out.fetch_add(count, std::memory_order_relaxed);
+    record.m_inclusive_ns.fetch_add(elapsed, std::memory_order_relaxed);
+    record.m_exclusive_ns.fetch_add(elapsed - scope.m_child_ns, std::memory_order_relaxed);
+    if (scope.m_parent)
+    {
+        scope.m_parent->m_child_ns += elapsed;
+        scope.m_parent->m_child_elements += count;
+    }
+}
+
+// Times pull, which returns the number of elements it produced, and accounts it to record.
+template <class Pull>
+auto profile_pull(profile_record& record, Pull&& pull) -> std::size_t
+{
+    profile_scope scope{ profile_scope::current() };
+    profile_scope::current() = &scope;
+    const auto start = std::chrono::steady_clock::now();
+    std::size_t count = 0;
+    try
+    {
+        count = pull();
+    }
+    catch (...)
+    {
+        profile_scope::current() = scope.m_parent;
+        throw;
+    }
+    const std::int64_t elapsed = elapsed_ns(start);
+    profile_scope::current() = scope.m_parent;
+    account_profile(record, scope, elapsed, count);
+    return count;
+}
+
+// Times push, which hands each element it produces to the downstream sink through the function it is given, and
+// accounts it to record. The time spent in the downstream sink belongs to the profile points downstream, so it is not
+// accounted, and pulls made there are not nested in the scope of this one.
+template <class Push>
+auto profile_push(profile_record& record, Push&& push) -> bool
+{
+    profile_scope scope{ profile_scope::current() };
+    profile_scope::current() = &scope;
+    const auto start = std::chrono::steady_clock::now();
+    std::int64_t downstream_ns = 0;
+    std::size_t count = 0;
+    const auto downstream = [&](auto&& sink) -> bool
+    {
+        profile_scope* const inner = profile_scope::current();
+        profile_scope::current() = scope.m_parent;
+        const auto sink_start = std::chrono::steady_clock::now();
+        const bool result = sink();
+        downstream_ns += elapsed_ns(sink_start);
+        profile_scope::current() = inner;
+        ++count;
+        return result;
+    };
+    bool result = false;
+    try
+    {
+        result = push(downstream);
+    }
+    catch (...)
+    {
+        profile_scope::current() = scope.m_parent;
+        throw;
+    }
+    const std::int64_t elapsed = elapsed_ns(start) - downstream_ns;
+    profile_scope::current() = scope.m_parent;
+    account_profile(record, scope, elapsed, count);
+    return result;
+}
+
+inline void write_json_string(std::ostream& os, const std::string& str)
+{
+    os << '"';
+    for (const char ch : str)
+    {
+        if (ch == '"' || ch == '\\')
+        {
+            os << '\\' << ch;
+        }
+        else if (static_cast<unsigned char>(ch) < 0x20)
+        {
+            os << ' ';
+        }
+        else
+        {
+            os << ch;
+        }
+    }
+    os << '"';
+}
+
+}  // namespace detail
+
+// Pipelines are instrumented by sequence::profile only while profiling is enabled, which it is not by default. The
+// profile points created while it is disabled return the sequence unchanged, and so cost nothing.
+inline void enable_profiling(bool enabled = true)
+{
+    detail::profiling_flag().store(enabled, std::memory_order_relaxed);
+}
+
+inline auto is_profiling_enabled() -> bool
+{
+    return detail::profiling_flag().load(std::memory_order_relaxed);
+}
+
+inline auto profile_results() -> std::vector<profile_stats>
+{
+    return detail::profile_registry::instance().stats();
+}
+
+inline void reset_profile()
+{
+    detail::profile_registry::instance().reset();
+}
+
+// Writes the statistics of all the profile points as a table.
+inline void print_profile(std::ostream& os)
+{
+    const auto ms = [](std::chrono::nanoseconds time) { return std::chrono::duration<double, std::milli>(time).count(); };
+    os << std::left << std::setw(24) << "stage" << std::right << std::setw(12) << "calls" << std::setw(14) << "in"
+       << std::setw(14) << "out" << std::setw(10) << "pass %" << std::setw(14) << "excl ms" << std::setw(14)
+       << "incl ms" << std::setw(14) << "excl ns/elem" << '\n';
+    for (const profile_stats& stats : profile_results())
+    {
+        os << std::left << std::setw(24) << stats.name << std::right << std::setw(12) << stats.calls << std::setw(14)
+           << stats.elements_in << std::setw(14) << stats.elements_out << std::fixed << std::setprecision(1)
+           << std::setw(10) << 100.0 * stats.pass_ratio() << std::setprecision(3) << std::setw(14)
+           << ms(stats.exclusive_time) << std::setw(14) << ms(stats.inclusive_time) << std::setprecision(1)
+           << std::setw(14)
+           << (stats.elements_out > 0 ? static_cast<double>(stats.exclusive_time.count()) / stats.elements_out : 0.0)
+           << '\n';
+    }
+}
+
+// Writes the statistics in the Chrome trace-event format (chrome://tracing, Perfetto): every profile point becomes a
+// complete event lasting its exclusive time, laid out one after another, with the counters as arguments.
+inline void write_profile_trace(std::ostream& os)
+{
+    const auto us = [](std::chrono::nanoseconds time) { return std::chrono::duration<double, std::micro>(time).count(); };
+    os << "{\"traceEvents\":[";
+    double ts = 0.0;
+    bool first = true;
+    for (const profile_stats& stats : profile_results())
+    {
+        os << (first ? "" : ",") << "{\"name\":";
+        detail::write_json_string(os, stats.name);
+        os << ",\"cat\":\"sequence\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":" << ts
+           << ",\"dur\":" << us(stats.exclusive_time) << ",\"args\":{\"calls\":" << stats.calls
+           << ",\"elements_in\":" << stats.elements_in << ",\"elements_out\":" << stats.elements_out
+           << ",\"pass_ratio\":" << stats.pass_ratio() << ",\"inclusive_us\":" << us(stats.inclusive_time) << "}}";
+        ts += us(stats.exclusive_time);
+        first = false;
+    }
+    os << "],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+}  // namespace core
+}  // namespace ferrugo
@@ -0,0 +1,569 @@
+#pragma once
+
+#include <ferrugo/core/sequence.hpp>
+#include <iterator>
+
+namespace ferrugo
+{
+namespace core
+{
+
+// static_sequence keeps the concrete type of every stage, so a whole pipeline is a single
+// nested function object which the compiler is free to inline. It converts to the type-erased
+// sequence<T> only when needed, e.g. when passed to a function taking sequence<T>.
+template <class Gen>
+struct static_sequence;
+
+template <class T>
+struct is_static_sequence : std::false_type
+{
+};
+
+template <class Gen>
+struct is_static_sequence<static_sequence<Gen>> : std::true_type
+{
+};
+
+template <class Gen>
+using generator_reference_t = maybe_underlying_type_t<std::invoke_result_t<const Gen&>>;
+
+template <class Gen>
+struct static_sequence
+{
+    using generator_type = Gen;
+    using reference = generator_reference_t<Gen>;
+    using value_type = std::decay_t<reference>;
+    using difference_type = std::ptrdiff_t;
+
+    template <class Func>
+    struct inspect_function
+    {
+        Func m_func;
+        Gen m_next;
+
+        auto operator()() const -> iteration_result_t<reference>
+        {
+            iteration_result_t<reference> next = m_next();
+            if (next)
+            {
+                std::invoke(m_func, *next);
+            }
+            return next;
+        }
+    };
+
+    template <class Func, class Out>
+    struct transform_function
+    {
+        Func m_func;
+        Gen m_next;
+
+        auto operator()() const -> iteration_result_t<Out>
+        {
+            iteration_result_t<reference> next = m_next();
+            if (next)
+            {
+                return std::invoke(m_func, *std::move(next));
+            }
+            return {};
+        }
+    };
+
+    template <class Func, class Out>
+    struct transform_indexed_function
+    {
+        Func m_func;
+        Gen m_next;
+        mutable std::ptrdiff_t m_index = 0;
+
+        auto operator()() const -> iteration_result_t<Out>
+        {
+            iteration_result_t<reference> next = m_next();
+            if (next)
+            {
+                return std::invoke(m_func, m_index++, *std::move(next));
+            }
+            return {};
+        }
+    };
+
+    template <class Func, class Out>
+    struct transform_maybe_function
+    {
+        Func m_func;
+        Gen m_next;
+
+        auto operator()() const -> iteration_result_t<Out>
+        {
+            while (true)
+            {
+                iteration_result_t<reference> res = m_next();
+                if (!res)
+                {
+                    break;
+                }
+
+                iteration_result_t<Out> r = std::invoke(m_func, *std::move(res));
+                if (r)
+                {
+                    return r;
+                }
+            }
+            return {};
+        }
+    };
+
+    template <class Pred>
+    struct filter_function
+    {
+        Pred m_pred;
+        Gen m_next;
+
+        auto operator()() const -> iteration_result_t<reference>
+        {
+            while (true)
+            {
+                iteration_result_t<reference> res = m_next();
+                if (!res)
+                {
+                    break;
+                }
+
+                if (std::invoke(m_pred, *res))
+                {
+                    return res;
+                }
+            }
+            return {};
+        }
+    };
+
+    template <class Pred>
+    struct filter_indexed_function
+    {
+        Pred m_pred;
+        Gen m_next;
+        mutable std::ptrdiff_t m_index = 0;
+
+        auto operator()() const -> iteration_result_t<reference>
+        {
+            while (true)
+            {
+                iteration_result_t<reference> res = m_next();
+                if (!res)
+                {
+                    break;
+                }
+
+                if (std::invoke(m_pred, m_index++, *res))
+                {
+                    return res;
+                }
+            }
+            return {};
+        }
+    };
+
+    template <class Pred>
+    struct take_while_function
+    {
+        Pred m_pred;
+        Gen m_next;
+
+        auto operator()() const -> iteration_result_t<reference>
+        {
+            iteration_result_t<reference> res = m_next();
+            if (!(res && std::invoke(m_pred, *res)))
+            {
+                return {};
+            }
+            return res;
+        }
+    };
+
+    template <class Pred>
+    struct drop_while_function
+    {
+        Pred m_pred;
+        Gen m_next;
+        mutable bool m_init = true;
+
+        auto operator()() const -> iteration_result_t<reference>
+        {
+            if (m_init)
+            {
+                while (true)
+                {
+                    iteration_result_t<reference> res = m_next();
+                    if (!res)
+                    {
+                        return {};
+                    }
+                    if (!std::invoke(m_pred, *res))
+                    {
+                        m_init = false;
+                        return res;
+                    }
+                }
+            }
+            return m_next();
+        }
+    };
+
+    struct take_function
+    {
+        mutable std::ptrdiff_t m_count;
+        Gen m_next;
+
+        auto operator()() const -> iteration_result_t<reference>
+        {
+            if (m_count <= 0)
+            {
+                return {};
+            }
+            --m_count;
+            return m_next();
+        }
+    };
+
+    struct drop_function
+    {
+        mutable std::ptrdiff_t m_count;
+        Gen m_next;
+
+        auto operator()() const -> iteration_result_t<reference>
+        {
+            while (m_count > 0)
+            {
+                --m_count;
+                if (!m_next())
+                {
+                    return {};
+                }
+            }
+            return m_next();
+        }
+    };
+
+    struct step_function
+    {
+        std::ptrdiff_t m_count;
+        Gen m_next;
+        mutable std::ptrdiff_t m_index = 0;
+
+        auto operator()() const -> iteration_result_t<reference>
+        {
+            while (true)
+            {
+                iteration_result_t<reference> res = m_next();
+                if (!res)
+                {
+                    break;
+                }
+
+                if (m_index++ % m_count == 0)
+                {
+                    return res;
+                }
+            }
+            return {};
+        }
+    };
+
+    Gen m_next_fn;
+
+    explicit static_sequence(Gen next_fn) : m_next_fn(std::move(next_fn))
+    {
+    }
+
+    auto get_next_function() const& -> const Gen&
+    {
+        return m_next_fn;
+    }
+
+    auto get_next_function() && -> Gen&&
+    {
+        return std::move(m_next_fn);
+    }
+
+    template <class Func>
+    auto inspect(Func&& func) const& -> static_sequence<inspect_function<std::decay_t<Func>>>
+    {
+        return make(inspect_function<std::decay_t<Func>>{ std::forward<Func>(func), m_next_fn });
+    }
+
+    template <class Func>
+    auto inspect(Func&& func) && -> static_sequence<inspect_function<std::decay_t<Func>>>
+    {
+        return make(inspect_function<std::decay_t<Func>>{ std::forward<Func>(func), std::move(m_next_fn) });
+    }
+
+    template <class Func, class Res = std::invoke_result_t<Func, reference>>
+    auto transform(Func&& func) const& -> static_sequence<transform_function<std::decay_t<Func>, Res>>
+    {
+        return make(transform_function<std::decay_t<Func>, Res>{ std::forward<Func>(func), m_next_fn });
+    }
+
+    template <class Func, class Res = std::invoke_result_t<Func, reference>>
+    auto transform(Func&& func) && -> static_sequence<transform_function<std::decay_t<Func>, Res>>
+    {
+        return make(transform_function<std::decay_t<Func>, Res>{ std::forward<Func>(func), std::move(m_next_fn) });
+    }
+
+    template <class Func, class Res = std::invoke_result_t<Func, std::ptrdiff_t, reference>>
+    auto transform_indexed(Func&& func) const& -> static_sequence<transform_indexed_function<std::decay_t<Func>, Res>>
+    {
+        return make(transform_indexed_function<std::decay_t<Func>, Res>{ std::forward<Func>(func), m_next_fn });
+    }
+
+    template <class Func, class Res = std::invoke_result_t<Func, std::ptrdiff_t, reference>>
+    auto transform_indexed(Func&& func) && -> static_sequence<transform_indexed_function<std::decay_t<Func>, Res>>
+    {
+        return make(transform_indexed_function<std::decay_t<Func>, Res>{ std::forward<Func>(func), std::move(m_next_fn) });
+    }
+
+    template <class Func, class Res = maybe_underlying_type_t<std::invoke_result_t<Func, reference>>>
+    auto transform_maybe(Func&& func) const& -> static_sequence<transform_maybe_function<std::decay_t<Func>, Res>>
+    {
+        return make(transform_maybe_function<std::decay_t<Func>, Res>{ std::forward<Func>(func), m_next_fn });
+    }
+
+    template <class Func, class Res = maybe_underlying_type_t<std::invoke_result_t<Func, reference>>>
+    auto transform_maybe(Func&& func) && -> static_sequence<transform_maybe_function<std::decay_t<Func>, Res>>
+    {
+        return make(transform_maybe_function<std::decay_t<Func>, Res>{ std::forward<Func>(func), std::move(m_next_fn) });
+    }
+
+    template <class Pred>
+    auto filter(Pred&& pred) const& -> static_sequence<filter_function<std::decay_t<Pred>>>
+    {
+        return make(filter_function<std::decay_t<Pred>>{ std::forward<Pred>(pred), m_next_fn });
+    }
+
+    template <class Pred>
+    auto filter(Pred&& pred) && -> static_sequence<filter_function<std::decay_t<Pred>>>
+    {
+        return make(filter_function<std::decay_t<Pred>>{ std::forward<Pred>(pred), std::move(m_next_fn) });
+    }
+
+    template <class Pred>
+    auto filter_indexed(Pred&& pred) const& -> static_sequence<filter_indexed_function<std::decay_t<Pred>>>
+    {
+        return make(filter_indexed_function<std::decay_t<Pred>>{ std::forward<Pred>(pred), m_next_fn });
+    }
+
+    template <class Pred>
+    auto filter_indexed(Pred&& pred) && -> static_sequence<filter_indexed_function<std::decay_t<Pred>>>
+    {
+        return make(filter_indexed_function<std::decay_t<Pred>>{ std::forward<Pred>(pred), std::move(m_next_fn) });
+    }
+
+    template <class Pred>
+    auto take_while(Pred&& pred) const& -> static_sequence<take_while_function<std::decay_t<Pred>>>
+    {
+        return make(take_while_function<std::decay_t<Pred>>{ std::forward<Pred>(pred), m_next_fn });
+    }
+
+    template <class Pred>
+    auto take_while(Pred&& pred) && -> static_sequence<take_while_function<std::decay_t<Pred>>>
+    {
+        return make(take_while_function<std::decay_t<Pred>>{ std::forward<Pred>(pred), std::move(m_next_fn) });
+    }
+
+    template <class Pred>
+    auto drop_while(Pred&& pred) const& -> static_sequence<drop_while_function<std::decay_t<Pred>>>
+    {
+        return make(drop_while_function<std::decay_t<Pred>>{ std::forward<Pred>(pred), m_next_fn });
+    }
+
+    template <class Pred>
+    auto drop_while(Pred&& pred) && -> static_sequence<drop_while_function<std::decay_t<Pred>>>
+    {
+        return make(drop_while_function<std::decay_t<Pred>>{ std::forward<Pred>(pred), std::move(m_next_fn) });
+    }
+
+    // A negative n takes nothing, as drop of a negative n drops nothing.
+    auto take(std::ptrdiff_t n) const& -> static_sequence<take_function>
+    {
+        return make(take_function{ n, m_next_fn });
+    }
+
+    auto take(std::ptrdiff_t n) && -> static_sequence<take_function>
+    {
+        return make(take_function{ n, std::move(m_next_fn) });
+    }
+
+    auto drop(std::ptrdiff_t n) const& -> static_sequence<drop_function>
+    {
+        return make(drop_function{ n, m_next_fn });
+    }
+
+    auto drop(std::ptrdiff_t n) && -> static_sequence<drop_function>
+    {
+        return make(drop_function{ n, std::move(m_next_fn) });
+    }
+
+    auto step(std::ptrdiff_t n) const& -> static_sequence<step_function>
+    {
+        return make(step_function{ n, m_next_fn });
+    }
+
+    auto step(std::ptrdiff_t n) && -> static_sequence<step_function>
+    {
+        return make(step_function{ n, std::move(m_next_fn) });
+    }
+
+    template <class Func>
+    void for_each(Func&& func) const
+    {
+        const Gen next_function = m_next_fn;
+        while (true)
+        {
+            iteration_result_t<reference> next = next_function();
+            if (!next)
+            {
+                break;
+            }
+            std::invoke(func, *std::move(next));
+        }
+    }
+
+    template <class Func>
+    void for_each_indexed(Func&& func) const
+    {
+        std::ptrdiff_t index = 0;
+        for_each([&](reference item) { std::invoke(func, index++, std::forward<reference>(item)); });
+    }
+
+    template <class Seed, class BinaryFunc>
+    auto accumulate(Seed seed, BinaryFunc&& func) const -> Seed
+    {
+        for_each([&](reference item) { seed = std::invoke(func, std::move(seed), std::forward<reference>(item)); });
+        return seed;
+    }
+
+    template <class Output>
+    auto copy(Output out) const -> Output
+    {
+        for_each([&](reference item) { *out++ = std::forward<reference>(item); });
+        return out;
+    }
+
+    auto maybe_front() const -> maybe<reference>
+    {
+        return Gen{ m_next_fn }();
+    }
+
+    template <class Pred>
+    auto find_if(Pred&& pred) const -> maybe<reference>
+    {
+        return drop_while(std::not_fn(std::forward<Pred>(pred))).maybe_front();
+    }
+
+    template <class U, require<std::is_constructible_v<U, reference>> = 0>
+    operator sequence<U>() const&
+    {
+        return sequence<U>{ sequence<reference>{ m_next_fn } };
+    }
+
+    template <class U, require<std::is_constructible_v<U, reference>> = 0>
+    operator sequence<U>() &&
+    {
+        return sequence<U>{ sequence<reference>{ std::move(m_next_fn) } };
+    }
+
+    template <
+        class Container,
+        require<!is_sequence<Container>::value> = 0,
+        require<std::is_constructible_v<Container, sequence_iterator<reference>, sequence_iterator<reference>>> = 0>
+    operator Container() const
+    {
+        Container result{};
+        copy(std::inserter(result, result.end()));
+        return result;
+    }
+
+    auto erase() const& -> sequence<reference>
+    {
+        return sequence<reference>{ m_next_fn };
+    }
+
+    auto erase() && -> sequence<reference>
+    {
+        return sequence<reference>{ std::move(m_next_fn) };
+    }
+
+private:
+    template <class G>
+    static auto make(G gen) -> static_sequence<G>
+    {
+        return static_sequence<G>{ std::move(gen) };
+    }
+};
+
+namespace detail
+{
+
+struct static_iota_fn
+{
+    template <class T>
+    auto operator()(T init) const -> static_sequence<iota_fn::next_function<T>>
+    {
+        return static_sequence<iota_fn::next_function<T>>{ { init } };
+    }
+};
+
+struct static_range_fn
+{
+    template <class T>
+    auto operator()(T lower, T upper) const -> static_sequence<range_fn::next_function<T>>
+    {
+        return static_sequence<range_fn::next_function<T>>{ { lower, upper } };
+    }
+
+    template <class T>
+    auto operator()(T upper) const -> static_sequence<range_fn::next_function<T>>
+    {
+        return (*this)(T{}, upper);
+    }
+};
+
+struct static_view_fn
+{
+    template <class Range, class Out = range_reference_t<Range>>
+    auto operator()(Range&& range) const -> static_sequence<view_fn::next_function<iterator_t<Range>, Out>>
+    {
+        return static_sequence<view_fn::next_function<iterator_t<Range>, Out>>{ { std::begin(range), std::end(range) } };
+    }
+
+    template <class Iter, class Out = iter_reference_t<Iter>>
+    auto operator()(Iter b, Iter e) const -> static_sequence<view_fn::next_function<Iter, Out>>
+    {
+        return static_sequence<view_fn::next_function<Iter, Out>>{ { b, e } };
+    }
+};
+
+struct static_unfold_fn
+{
+    template <
+        class S,
+        class Func,
+        class OptRes = std::invoke_result_t<Func, const S&>,
+        class Res = maybe_underlying_type_t<OptRes>,
+        class Out = std::tuple_element_t<0, Res>>
+    auto operator()(S state, Func&& func) const -> static_sequence<unfold_fn::next_function<std::decay_t<Func>, S, Out>>
+    {
+        return static_sequence<unfold_fn::next_function<std::decay_t<Func>, S, Out>>{ { std::forward<Func>(func),
+                                                                                       std::move(state) } };
+    }
+};
+
+}  // namespace detail
+
+static constexpr inline auto static_iota = detail::static_iota_fn{};
+static constexpr inline auto static_range = detail::static_range_fn{};
+static constexpr inline auto static_view = detail::static_view_fn{};
+static constexpr inline auto static_unfold = detail::static_unfold_fn{};
+
+}  // namespace core
+}  // namespace ferrugo
@@ -0,0 +1,45 @@
+#include <catch2/catch_test_macros.hpp>
+#include <ferrugo/core/bloom_filter.hpp>
+#include <string>
+
+using namespace ferrugo;
+
+TEST_CASE("bloom_filter - no false negatives", "[bloom_filter]")
+{
+    core::bloom_filter<std::string> filter{ 4096, 4 };
+    REQUIRE(filter.bit_count() == 4096);
+    REQUIRE(filter.hash_count() == 4);
+    REQUIRE(!filter.contains("a"));
+    REQUIRE(filter.insert("a"));
+    REQUIRE(!filter.insert("a"));
+    REQUIRE(filter.contains("a"));
+
+    for (int i = 0; i < 200; ++i)
+    {
+        filter.insert(std::to_string(i));
+    }
+    for (int i = 0; i < 200; ++i)
+    {
+        REQUIRE(filter.contains(std::to_string(i)));
+    }
+    filter.clear();
+    REQUIRE(!filter.contains("a"));
+}
+
+TEST_CASE("bloom_filter - false positive rate", "[bloom_filter]")
+{
+    auto filter = core::bloom_filter<int>::for_capacity(10000, 0.01);
+    for (int i = 0; i < 10000; ++i)
+    {
+        filter.insert(i);
+    }
+    int false_positives = 0;
+    for (int i = 10000; i < 110000; ++i)
+    {
+        false_positives += filter.contains(i) ? 1 : 0;
+    }
+    REQUIRE(false_positives < 2000);
+
+    REQUIRE_THROWS_AS(core::bloom_filter<int>(1024, 0), std::invalid_argument);
+    REQUIRE_THROWS_AS(core::bloom_filter<int>::for_capacity(10, 1.5), std::invalid_argument);
+}
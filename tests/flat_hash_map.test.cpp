@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <ferrugo/core/flat_hash_map.hpp>
+#include <string>
+#include <vector>
+
+using namespace ferrugo;
+
+TEST_CASE("flat_hash_map - insert and find", "[flat_hash_map]")
+{
+    core::flat_hash_map<int, std::string> map;
+    REQUIRE(map.empty());
+    REQUIRE(map.find(1) == map.end());
+
+    REQUIRE(map.try_emplace(1, "one").second);
+    REQUIRE(map.try_emplace(2, "two").second);
+    REQUIRE(!map.try_emplace(1, "uno").second);
+    map[3] = "three";
+
+    REQUIRE(map.size() == 3);
+    REQUIRE(map.at(1) == "one");
+    REQUIRE(map.find(2)->second == "two");
+    REQUIRE(map.contains(3));
+    REQUIRE(!map.contains(4));
+    REQUIRE_THROWS_AS(map.at(4), std::out_of_range);
+}
+
+TEST_CASE("flat_hash_map - growth keeps entries in insertion order", "[flat_hash_map]")
+{
+    core::flat_hash_map<int, int> map;
+    for (int i = 0; i < 10000; ++i)
+    {
+        map[i * 1024] += i;
+    }
+    REQUIRE(map.size() == 10000);
+    REQUIRE(map.capacity() >= 10000);
+
+    std::vector<int> keys;
+    bool values_match = true;
+    for (const auto& [key, value] : map)
+    {
+        keys.push_back(key);
+        values_match = values_match && value == key / 1024;
+    }
+    REQUIRE(values_match);
+    REQUIRE(keys.front() == 0);
+    REQUIRE(keys.back() == 9999 * 1024);
+    REQUIRE(std::is_sorted(keys.begin(), keys.end()));
+}
+
+TEST_CASE("flat_hash_map - clear keeps capacity", "[flat_hash_map]")
+{
+    core::flat_hash_map<std::string, int> map{ 100 };
+    const std::size_t capacity = map.capacity();
+    REQUIRE(capacity >= 100);
+
+    map["a"] = 1;
+    map["b"] = 2;
+    map.clear();
+    REQUIRE(map.empty());
+    REQUIRE(!map.contains("a"));
+    REQUIRE(map.capacity() == capacity);
+
+    map["b"] = 3;
+    REQUIRE(map.at("b") == 3);
+}
+
+TEST_CASE("flat_hash_set - insert and contains", "[flat_hash_map]")
+{
+    core::flat_hash_set<std::string> set;
+    REQUIRE(set.insert("a"));
+    REQUIRE(set.insert("b"));
+    REQUIRE(!set.insert("a"));
+    REQUIRE(set.size() == 2);
+    REQUIRE(set.contains("b"));
+    REQUIRE(!set.contains("c"));
+    set.clear();
+    REQUIRE(set.empty());
+    REQUIRE(!set.contains("a"));
+}
@@ -0,0 +1,884 @@
+#include <algorithm>
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <ferrugo/core/sequence.hpp>
+#include <functional>
+#include <list>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+using namespace ferrugo;
+
+TEST_CASE("sequence - adaptors", "[sequence]")
+{
+    const std::vector<int> result = core::range(0, 20)
+                                        .transform([](int x) { return x * 3; })
+                                        .filter([](int x) { return x % 2 == 0; })
+                                        .drop(1)
+                                        .take(4);
+    REQUIRE(result == std::vector<int>{ 6, 12, 18, 24 });
+}
+
+TEST_CASE("sequence - next_batch", "[sequence]")
+{
+    const std::vector<int> v = { 1, 2, 3, 4, 5, 6, 7 };
+    const auto next_function
+        = core::view(v).transform([](int x) { return x * 10; }).filter([](int x) { return x != 30; }).get_next_function();
+
+    std::vector<core::iteration_result_t<int>> batch(4);
+    REQUIRE(next_function.next_batch(batch.data(), batch.size()) == 3);
+    REQUIRE(batch[0] == 10);
+    REQUIRE(batch[2] == 40);
+    REQUIRE(next_function() == 50);
+    REQUIRE(next_function.next_batch(batch.data(), batch.size()) == 2);
+    REQUIRE(batch[1] == 70);
+    REQUIRE(next_function.next_batch(batch.data(), batch.size()) == 0);
+}
+
+TEST_CASE("sequence - batched terminals", "[sequence]")
+{
+    const auto seq = core::iota(0).take_while([](int x) { return x < 1000; });
+    REQUIRE(seq.accumulate(0, std::plus<>{}) == 499500);
+
+    std::vector<int> copied;
+    seq.take(3).copy(std::back_inserter(copied));
+    REQUIRE(copied == std::vector<int>{ 0, 1, 2 });
+
+    const std::vector<std::string> strings = core::vec(std::string{ "a" }, std::string{ "b" });
+    REQUIRE(strings == std::vector<std::string>{ "a", "b" });
+}
+
+TEST_CASE("sequence - parallel terminals", "[sequence]")
+{
+    const auto seq = core::range(0, 10000).transform([](int x) { return x * 2; });
+    const core::parallel_options options{ 4, 64 };
+
+    REQUIRE(seq.par_accumulate(0L, std::plus<>{}, options) == 99990000L);
+
+    const std::vector<int> squares = seq.par_to_vector([](int x) { return x * x; }, options);
+    REQUIRE(squares.size() == 10000);
+    REQUIRE(squares[1] == 4);
+    REQUIRE(squares[9999] == 19998 * 19998);
+
+    const std::vector<int> copied = seq.par_to_vector(options);
+    REQUIRE(copied == std::vector<int>(seq));
+
+    std::atomic<long> sum{ 0 };
+    seq.par_for_each([&](int x) { sum += x; }, options);
+    REQUIRE(sum == 99990000L);
+}
+
+TEST_CASE("sequence - parallel accumulate preserves order", "[sequence]")
+{
+    const auto seq = core::range(0, 500).transform([](int x) { return std::to_string(x % 10); });
+    const std::string expected = seq.accumulate(std::string{}, std::plus<>{});
+    REQUIRE(seq.par_accumulate(std::string{}, std::plus<>{}, core::parallel_options{ 3, 7 }) == expected);
+}
+
+TEST_CASE("sequence - parallel terminals split the pipeline", "[sequence]")
+{
+    const std::vector<int> v = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    const auto parts = core::view(v).transform([](int x) { return x * 10; }).get_next_function().split(3);
+    REQUIRE(parts.size() == 3);
+    std::vector<int> joined;
+    for (const auto& part : parts)
+    {
+        while (const auto next = part())
+        {
+            joined.push_back(*next);
+        }
+    }
+    REQUIRE(joined == std::vector<int>{ 10, 20, 30, 40, 50, 60, 70, 80, 90, 100 });
+    REQUIRE(core::range(0, 2).get_next_function().split(4).size() == 2);
+    REQUIRE(core::view(v).take(3).get_next_function().split(4).empty());
+
+    const core::parallel_options options{ 4, 16 };
+    const auto odd = core::owning(std::vector<int>(1000, 1))
+                         .transform_indexed([](std::ptrdiff_t i, int x) { return static_cast<int>(i) * x; })
+                         .filter([](int x) { return x % 2 == 1; });
+    REQUIRE(odd.par_to_vector(options) == std::vector<int>(odd));
+
+    const auto evens = core::owning(std::vector<int>(1000, 2))
+                           .transform([](int x) { return x + 1; })
+                           .filter([](int x) { return x % 2 == 1; });
+    REQUIRE(evens.par_accumulate(0, std::plus<>{}, options) == 3000);
+
+    // Capturing callables may share state, so their stages run under the lock rather than on copies.
+    int factor = 10;
+    REQUIRE(core::view(v).transform([&](int x) { return x * factor; }).get_next_function().split(3).empty());
+    const std::function<bool(int)> erased = [](int x) { return x > 1; };
+    REQUIRE(core::view(v).filter(erased).get_next_function().split(3).empty());
+    int inspected = 0;
+    const auto counted = core::range(0, 1000).inspect([&](int) { ++inspected; });
+    REQUIRE(counted.par_accumulate(0, std::plus<>{}, options) == 499500);
+    REQUIRE(inspected == 1000);
+
+    const auto nested = core::range(0, 20).transform(
+        [&](int x) { return core::range(0, x).par_accumulate(0, std::plus<>{}, options); });
+    REQUIRE(nested.par_to_vector(options) == std::vector<int>(nested));
+}
+
+TEST_CASE("sequence - size_hint", "[sequence]")
+{
+    const std::vector<int> v = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    const auto exact = [](std::size_t n) { return core::size_hint_t::exact(n); };
+    const auto same = [](const core::size_hint_t& lhs, const core::size_hint_t& rhs)
+    { return lhs.lower == rhs.lower && lhs.upper == rhs.upper; };
+
+    REQUIRE(same(core::view(v).size_hint(), exact(10)));
+    REQUIRE(same(core::range(3, 8).size_hint(), exact(5)));
+    REQUIRE(same(core::vec(1, 2, 3).size_hint(), exact(3)));
+    REQUIRE(same(core::single(1).size_hint(), exact(1)));
+    REQUIRE(same(core::iota(0).take(4).size_hint(), exact(4)));
+    REQUIRE(same(core::repeat(1).take(4).size_hint(), exact(4)));
+    REQUIRE(same(core::view(v).drop(3).transform([](int x) { return x * 2; }).size_hint(), exact(7)));
+    REQUIRE(same(core::view(v).step(3).size_hint(), exact(4)));
+    REQUIRE(same(core::concat(core::view(v), core::range(0, 5)).size_hint(), exact(15)));
+    REQUIRE(same(core::zip(core::view(v), core::range(0, 5)).size_hint(), exact(5)));
+
+    const core::size_hint_t filtered = core::view(v).filter([](int x) { return x > 3; }).take(4).size_hint();
+    REQUIRE(filtered.lower == 0);
+    REQUIRE(filtered.upper == 4u);
+
+    const std::vector<int> result = core::view(v).step(3);
+    REQUIRE(result == std::vector<int>{ 1, 4, 7, 10 });
+    REQUIRE(result.capacity() == 4);
+}
+
+TEST_CASE("sequence - stages must be copyable", "[sequence]")
+{
+    struct move_only_counter
+    {
+        std::unique_ptr<int> m_value = std::make_unique<int>(0);
+
+        auto operator()() const -> core::iteration_result_t<int>
+        {
+            return *m_value < 3 ? core::iteration_result_t<int>{ (*m_value)++ } : core::iteration_result_t<int>{};
+        }
+    };
+
+    struct shared_counter
+    {
+        std::shared_ptr<int> m_value = std::make_shared<int>(0);
+
+        auto operator()() const -> core::iteration_result_t<int>
+        {
+            return *m_value < 3 ? core::iteration_result_t<int>{ (*m_value)++ } : core::iteration_result_t<int>{};
+        }
+    };
+
+    STATIC_REQUIRE(!std::is_constructible_v<core::next_function_t<int>, move_only_counter>);
+    STATIC_REQUIRE(std::is_constructible_v<core::next_function_t<int>, shared_counter>);
+
+    core::next_function_t<int> next_function = shared_counter{};
+    core::next_function_t<int> moved = std::move(next_function);
+    REQUIRE(!next_function);
+    REQUIRE(moved() == 0);
+
+    const core::sequence<int> seq = core::sequence<int>{ std::move(moved) }.transform([](int x) { return x * 10; });
+    int sum = 0;
+    seq.for_each([&](int x) { sum += x; });
+    REQUIRE(sum == 30);
+}
+
+TEST_CASE("sequence - advance", "[sequence]")
+{
+    using ints = std::vector<int>;
+
+    std::vector<int> v(100);
+    std::iota(v.begin(), v.end(), 0);
+    int calls = 0;
+    const core::sequence<int> counted = core::view(v).transform(
+        [&](int x)
+        {
+            ++calls;
+            return x * 2;
+        });
+
+    REQUIRE(ints(counted.drop(90).take(3)) == ints{ 180, 182, 184 });
+    REQUIRE(calls == 3);
+    REQUIRE(*counted.maybe_at(42) == 84);
+    REQUIRE(!counted.maybe_at(100));
+    REQUIRE(ints(counted.step(30)) == ints{ 0, 60, 120, 180 });
+    REQUIRE(calls == 8);
+
+    REQUIRE(*core::iota(0).drop(1000).maybe_front() == 1000);
+    REQUIRE(ints(core::range(0, 10).step(4).drop(1)) == ints{ 4, 8 });
+    REQUIRE(ints(core::concat(core::range(0, 3), core::range(10, 13)).drop(4)) == ints{ 11, 12 });
+    REQUIRE(core::zip(core::range(0, 5), core::iota(10)).drop(3).size_hint().lower == 2);
+    REQUIRE(*core::view(v).filter([](int x) { return x % 3 == 0; }).drop(2).maybe_front() == 6);
+
+    const std::list<int> l = { 1, 2, 3, 4, 5 };
+    REQUIRE(ints(core::view(l).step(2).drop(1)) == ints{ 3, 5 });
+}
+
+TEST_CASE("sequence - take of a negative count", "[sequence]")
+{
+    using ints = std::vector<int>;
+    const ints v = { 1, 2, 3 };
+    const auto taken = core::view(v).take(-1);
+
+    REQUIRE(ints(taken).empty());
+    ints pulled;
+    for (int x : taken)
+    {
+        pulled.push_back(x);
+    }
+    REQUIRE(pulled.empty());
+    REQUIRE(taken.size_hint().lower == 0);
+    REQUIRE(taken.size_hint().upper == 0u);
+    REQUIRE(taken.count() == 0);
+    REQUIRE(taken.accumulate(0, std::plus<>{}) == 0);
+    REQUIRE(!taken.drop(1).maybe_front());
+    REQUIRE(ints(core::view(v).filter([](int x) { return x > 1; }).take(-5)).empty());
+}
+
+TEST_CASE("sequence - windows", "[sequence]")
+{
+    using ints = std::vector<int>;
+    const auto to_vectors = [](auto seq)
+    {
+        std::vector<ints> result;
+        seq.for_each([&](core::span<int> w) { result.emplace_back(w.begin(), w.end()); });
+        return result;
+    };
+
+    REQUIRE(to_vectors(core::range(0, 7).chunk(3)) == std::vector<ints>{ { 0, 1, 2 }, { 3, 4, 5 }, { 6 } });
+    REQUIRE(to_vectors(core::range(0, 6).chunk(3)) == std::vector<ints>{ { 0, 1, 2 }, { 3, 4, 5 } });
+    REQUIRE(to_vectors(core::range(0, 5).window(3)) == std::vector<ints>{ { 0, 1, 2 }, { 1, 2, 3 }, { 2, 3, 4 } });
+    REQUIRE(to_vectors(core::range(0, 2).window(3)).empty());
+    REQUIRE(to_vectors(core::range(0, 9).window_step(2, 3)) == std::vector<ints>{ { 0, 1 }, { 3, 4 }, { 6, 7 } });
+    REQUIRE(
+        to_vectors(core::range(0, 8).window_step(4, 2))
+        == std::vector<ints>{ { 0, 1, 2, 3 }, { 2, 3, 4, 5 }, { 4, 5, 6, 7 } });
+
+    const auto sum = [](core::span<int> w) { return std::accumulate(w.begin(), w.end(), 0); };
+    const core::sequence<int> sums = core::range(0, 100).window(10).transform(sum);
+    REQUIRE(sums.size_hint().lower == 91);
+    REQUIRE(ints(sums).back() == 945);
+    REQUIRE(
+        to_vectors(core::range(0, 10).window(3).filter([](core::span<int> w) { return w.front() % 2 == 1; }).take(2))
+        == std::vector<ints>{ { 1, 2, 3 }, { 3, 4, 5 } });
+    REQUIRE(core::range(0, 10).chunk(4).size_hint().upper == 3u);
+    REQUIRE(core::range(0, 10).window_step(3, 4).size_hint().lower == 2);
+
+    const std::vector<ints> owned = core::range(0, 5).chunk_owning(2);
+    REQUIRE(owned == std::vector<ints>{ { 0, 1 }, { 2, 3 }, { 4 } });
+    REQUIRE_THROWS_AS(core::range(0, 5).window(0), std::invalid_argument);
+
+    // Windows of contiguous sources are views of the source.
+    const ints v = { 0, 1, 2, 3, 4, 5, 6 };
+    REQUIRE(to_vectors(core::view(v).chunk(3)) == std::vector<ints>{ { 0, 1, 2 }, { 3, 4, 5 }, { 6 } });
+    REQUIRE(to_vectors(core::view(v).window_step(2, 3)) == std::vector<ints>{ { 0, 1 }, { 3, 4 } });
+    REQUIRE(ints(core::view(v).window(3).transform(sum)) == ints{ 3, 6, 9, 12, 15 });
+    REQUIRE(core::view(v).window(3).maybe_at(2)->begin() == v.data() + 2);
+
+    std::vector<core::iteration_result_t<core::span<int>>> batch(8);
+    REQUIRE(core::view(v).window(3).get_next_function().next_batch(batch.data(), batch.size()) == 5);
+    REQUIRE(batch[0]->front() == 0);
+    REQUIRE(batch[4]->front() == 4);
+    REQUIRE(core::range(0, 7).window(3).get_next_function().next_batch(batch.data(), batch.size()) == 1);
+
+    const auto next_function = core::view(v).window_step(2, 2).get_next_function();
+    REQUIRE(next_function()->front() == 0);
+    REQUIRE(next_function.size_hint().upper == 2u);
+    std::vector<ints> rest;
+    REQUIRE(next_function.push(
+        [&](core::span<int> w)
+        {
+            rest.emplace_back(w.begin(), w.end());
+            return true;
+        }));
+    REQUIRE(rest == std::vector<ints>{ { 2, 3 }, { 4, 5 } });
+    REQUIRE(!next_function());
+}
+
+TEST_CASE("sequence - numeric reductions", "[sequence]")
+{
+    std::vector<double> v(1000);
+    std::iota(v.begin(), v.end(), 1.0);
+    const std::vector<int> w = { 3, -1, 4, 1, -5, 9, 2, 6 };
+
+    REQUIRE(core::view(v).sum() == 500500.0);
+    REQUIRE(core::owning(v).drop(10).take(10).sum() == 155.0);
+    REQUIRE(core::range(0, 1000).filter([](int x) { return x % 2 == 0; }).sum<long long>() == 249500);
+    REQUIRE(core::view(w).sum() == 19);
+    REQUIRE(*core::view(w).min() == -5);
+    REQUIRE(*core::view(w).max() == 9);
+    REQUIRE(*core::range(0, 500).transform([](int x) { return (x * 37) % 500; }).minmax() == std::pair{ 0, 499 });
+    REQUIRE(!core::view(std::vector<int>{}).min());
+    REQUIRE(core::view(v).dot(core::view(v)) == 333833500.0);
+    REQUIRE(core::range(0, 300).dot(core::view(w)) == 0 * 3 - 1 + 8 + 3 - 20 + 45 + 12 + 42);
+
+    REQUIRE(core::view(v).count() == 1000);
+    REQUIRE(core::view(v).filter([](double x) { return x > 900; }).count() == 100);
+    REQUIRE(core::view(w).window(3).count() == 6);
+    REQUIRE_THROWS_AS(core::iota(0).count(), std::length_error);
+    REQUIRE_THROWS_AS(core::repeat(1).transform([](int x) { return x + 1; }).count(), std::length_error);
+    REQUIRE(core::iota(0).take(5).count() == 5);
+}
+
+TEST_CASE("sequence - cache", "[sequence]")
+{
+    using ints = std::vector<int>;
+
+    std::atomic<int> calls{ 0 };
+    const core::sequence<const int&> cached = core::range(0, 3000)
+                                                  .transform(
+                                                      [&](int x)
+                                                      {
+                                                          ++calls;
+                                                          return x * 2;
+                                                      })
+                                                  .cache();
+
+    REQUIRE(calls == 0);
+    REQUIRE(*cached.maybe_at(5) == 10);
+    REQUIRE(calls < 3000);
+    REQUIRE(cached.size_hint().lower == 3000);
+
+    const ints expected = core::range(0, 3000).transform([](int x) { return x * 2; });
+    REQUIRE(ints(cached) == expected);
+    REQUIRE(ints(cached) == expected);
+    REQUIRE(calls == 3000);
+
+    std::vector<long long> sums(4);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < sums.size(); ++i)
+    {
+        threads.emplace_back([&, i] { sums[i] = cached.accumulate(0LL, std::plus<>{}); });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    REQUIRE(sums == std::vector<long long>(4, 2999LL * 3000));
+    REQUIRE(calls == 3000);
+}
+
+TEST_CASE("sequence - top_k", "[sequence]")
+{
+    using ints = std::vector<int>;
+    const auto sorted = [](ints v)
+    {
+        std::sort(v.begin(), v.end());
+        return v;
+    };
+    const core::sequence<int> values = core::range(0, 1000).transform([](int x) { return (x * 7919) % 1000; });
+
+    REQUIRE(sorted(values.top_k(5)) == ints{ 995, 996, 997, 998, 999 });
+    REQUIRE(sorted(values.bottom_k(3)) == ints{ 0, 1, 2 });
+    REQUIRE(values.sorted_take(4) == ints{ 0, 1, 2, 3 });
+    REQUIRE(values.sorted_take(3, std::greater<>{}) == ints{ 999, 998, 997 });
+    REQUIRE(sorted(core::vec(3, 1, 2).top_k(10)) == ints{ 1, 2, 3 });
+    REQUIRE(values.top_k(0).empty());
+
+    const std::vector<std::string> words = { "pear", "fig", "banana", "kiwis", "apple" };
+    const auto by_length = [](const std::string& lhs, const std::string& rhs) { return lhs.size() < rhs.size(); };
+    REQUIRE(core::view(words).sorted_take(2, by_length) == std::vector<std::string>{ "fig", "pear" });
+}
+
+TEST_CASE("sequence - aggregate_by", "[sequence]")
+{
+    const core::sequence<int> values = core::range(0, 100);
+    const auto mod = [](int x) { return x % 3; };
+
+    const auto sums = values.aggregate_by(mod, 0LL, std::plus<>{});
+    REQUIRE(sums.size() == 3);
+    REQUIRE(sums.at(0) == 1683);
+    REQUIRE(sums.at(1) == 1617);
+    REQUIRE(sums.at(2) == 1650);
+    REQUIRE(sums.begin()->first == 0);
+
+    const auto groups = core::vec(std::string{ "apple" }, std::string{ "avocado" }, std::string{ "banana" })
+                            .group_by([](const std::string& s) { return s.front(); });
+    REQUIRE(groups.at('a') == std::vector<std::string>{ "apple", "avocado" });
+    REQUIRE(groups.at('b') == std::vector<std::string>{ "banana" });
+
+    const std::vector<std::pair<int, long long>> partials
+        = core::vec(1, 2, 1, 3, 1, 2).partial_aggregate_by(2, [](int x) { return x; }, 0LL, std::plus<>{});
+    REQUIRE(partials == std::vector<std::pair<int, long long>>{ { 1, 2 }, { 2, 2 }, { 3, 3 }, { 1, 1 }, { 2, 2 } });
+
+    long long total = 0;
+    values.partial_aggregate_by(2, mod, 0LL, std::plus<>{}).for_each([&](const auto& p) { total += p.second; });
+    REQUIRE(total == 4950);
+}
+
+TEST_CASE("sequence - iterators share the pipeline", "[sequence]")
+{
+    struct counted_stage
+    {
+        int* m_copies;
+        mutable int m_value = 0;
+
+        counted_stage(int* copies) : m_copies(copies)
+        {
+        }
+
+        counted_stage(const counted_stage& other) : m_copies(other.m_copies), m_value(other.m_value)
+        {
+            ++*m_copies;
+        }
+
+        counted_stage(counted_stage&&) noexcept = default;
+
+        auto operator()() const -> core::iteration_result_t<int>
+        {
+            return m_value < 100 ? core::iteration_result_t<int>{ m_value++ } : core::iteration_result_t<int>{};
+        }
+    };
+
+    int copies = 0;
+    const core::sequence<int> seq{ counted_stage{ &copies } };
+    REQUIRE(copies == 0);
+
+    const auto it = seq.begin();
+    REQUIRE(copies == 1);
+    REQUIRE(std::accumulate(it, seq.end(), 0) == 4950);
+    REQUIRE(copies == 1);
+
+    auto other = seq.begin();
+    other = seq.begin();
+    REQUIRE(*other++ == 0);
+    REQUIRE(*other == 1);
+}
+
+TEST_CASE("sequence - prefetch", "[sequence]")
+{
+    using ints = std::vector<int>;
+
+    std::atomic<bool> off_thread{ false };
+    const auto main_thread = std::this_thread::get_id();
+    const core::sequence<int> prefetched = core::range(0, 1000)
+                                               .inspect([&](int) { off_thread = std::this_thread::get_id() != main_thread; })
+                                               .prefetch(64);
+
+    REQUIRE(ints(prefetched) == ints(core::range(0, 1000)));
+    REQUIRE(off_thread);
+    REQUIRE(prefetched.transform([](int x) { return x * 2; }).sum() == 999000);
+
+    REQUIRE(ints(core::iota(0).prefetch(16).take(5)) == ints{ 0, 1, 2, 3, 4 });
+
+    // Copies of a started stage split the remaining elements, the current batch included.
+    const auto started = core::range(0, 100).prefetch(64).get_next_function();
+    REQUIRE(started() == 0);
+    const auto copy = started;
+    ints rest;
+    for (bool from_copy = true;; from_copy = !from_copy)
+    {
+        const auto next = from_copy ? copy() : started();
+        if (!next)
+        {
+            break;
+        }
+        rest.push_back(*next);
+    }
+    REQUIRE(rest == ints(core::range(1, 100)));
+
+    const auto failing = core::range(0, 10).transform(
+        [](int x)
+        {
+            if (x == 7)
+            {
+                throw std::runtime_error{ "failure" };
+            }
+            return x;
+        });
+    REQUIRE_THROWS_AS(ints(failing.prefetch(2)), std::runtime_error);
+}
+
+TEST_CASE("sequence - profile", "[sequence]")
+{
+    const auto find = [](const std::string& name)
+    {
+        const std::vector<core::profile_stats> results = core::profile_results();
+        return *std::find_if(results.begin(), results.end(), [&](const auto& stats) { return stats.name == name; });
+    };
+
+    // Profile points created while profiling is disabled leave the sequence unchanged.
+    REQUIRE(!core::is_profiling_enabled());
+    const std::vector<int> small = { 1, 2, 3 };
+    const auto plain = core::view(small);
+    REQUIRE(static_cast<bool>(plain.profile("test.disabled").get_next_function().contiguous()));
+    REQUIRE(plain.profile("test.disabled").sum() == 6);
+    const std::vector<core::profile_stats> before = core::profile_results();
+    REQUIRE(std::none_of(before.begin(), before.end(), [](const auto& stats) { return stats.name == "test.disabled"; }));
+
+    core::enable_profiling();
+    core::reset_profile();
+    const int sum = core::range(0, 100)
+                        .profile("test.range")
+                        .filter([](int x) { return x % 4 == 0; })
+                        .profile("test.filter")
+                        .transform([](int x) { return x / 4; })
+                        .sum();
+    REQUIRE(sum == 300);
+
+    const core::profile_stats range = find("test.range");
+    REQUIRE(range.elements_in == 0);
+    REQUIRE(range.elements_out == 100);
+
+    const core::profile_stats filter = find("test.filter");
+    REQUIRE(filter.elements_in == 100);
+    REQUIRE(filter.elements_out == 25);
+    REQUIRE(filter.pass_ratio() == 0.25);
+    REQUIRE(filter.exclusive_time <= filter.inclusive_time);
+
+    std::ostringstream table;
+    core::print_profile(table);
+    REQUIRE(table.str().find("test.filter") != std::string::npos);
+
+    std::ostringstream trace;
+    core::write_profile_trace(trace);
+    REQUIRE(trace.str().find("{\"traceEvents\":[") == 0);
+    REQUIRE(trace.str().find("\"name\":\"test.filter\"") != std::string::npos);
+
+    // Pushes are accounted, and the profile points split with their pipeline.
+    const std::vector<int> values(1000, 1);
+    const auto pushed = core::view(values).profile("test.source").transform([](int x) { return x * 2; }).profile(
+        "test.push");
+    int pushed_sum = 0;
+    pushed.for_each([&](int x) { pushed_sum += x; });
+    REQUIRE(pushed_sum == 2000);
+    REQUIRE(find("test.source").elements_out == 1000);
+    REQUIRE(find("test.push").elements_in == 1000);
+    REQUIRE(find("test.push").elements_out == 1000);
+    REQUIRE(find("test.push").calls == 1);
+
+    REQUIRE(pushed.get_next_function().split(4).size() == 4);
+    REQUIRE(pushed.par_accumulate(0, std::plus<>{}, core::parallel_options{ 4, 16 }) == 2000);
+    REQUIRE(find("test.push").elements_out == 2000);
+    core::enable_profiling(false);
+}
+
+TEST_CASE("sequence - merge_sorted", "[sequence]")
+{
+    using ints = std::vector<int>;
+
+    const ints a = { 1, 4, 7, 10 };
+    const ints b = { 2, 5, 8 };
+    REQUIRE(ints(core::merge_sorted(core::view(a), core::view(b), core::range(3, 10).step(3)))
+            == ints{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 });
+    REQUIRE(
+        ints(core::merge_sorted(core::view(b.rbegin(), b.rend()), core::view(a.rbegin(), a.rend()), std::greater<>{}))
+        == ints{ 10, 8, 7, 5, 4, 2, 1 });
+    REQUIRE(ints(core::merge_sorted(core::iota(0).step(2), core::iota(1).step(2)).take(6)) == ints{ 0, 1, 2, 3, 4, 5 });
+
+    std::vector<core::sequence<int>> shards;
+    for (int shard = 0; shard < 37; ++shard)
+    {
+        shards.push_back(core::range(shard, 1000).step(37));
+    }
+    const core::sequence<int> merged = core::merge_sorted(shards);
+    REQUIRE(merged.size_hint().lower == 1000);
+    REQUIRE(ints(merged) == ints(core::range(0, 1000)));
+    REQUIRE(ints(core::merge_sorted(std::vector<core::sequence<int>>{})).empty());
+
+    // Equal elements come in the order of the sequences.
+    using entry = std::pair<int, char>;
+    const std::vector<entry> lhs = { { 1, 'a' }, { 2, 'a' }, { 2, 'a' } };
+    const std::vector<entry> rhs = { { 1, 'b' }, { 2, 'b' } };
+    const auto by_first = [](const entry& l, const entry& r) { return l.first < r.first; };
+    REQUIRE(
+        std::vector<entry>(core::merge_sorted(core::view(lhs), core::view(rhs), by_first))
+        == std::vector<entry>{ { 1, 'a' }, { 1, 'b' }, { 2, 'a' }, { 2, 'a' }, { 2, 'b' } });
+}
+
+TEST_CASE("sequence - distinct", "[sequence]")
+{
+    using ints = std::vector<int>;
+
+    const ints values = { 3, 1, 3, 2, 1, 5, 2 };
+    REQUIRE(ints(core::view(values).distinct()) == ints{ 3, 1, 2, 5 });
+    REQUIRE(ints(core::view(values).distinct_by([](int x) { return x % 2; })) == ints{ 3, 2 });
+    REQUIRE(ints(core::iota(0).transform([](int x) { return x / 3; }).distinct().take(4)) == ints{ 0, 1, 2, 3 });
+
+    // The approximate variant never yields duplicates, and drops few unique elements.
+    const ints deduplicated = core::concat(core::range(0, 1000), core::range(0, 1000))
+                                  .distinct(core::bloom_filter<int>::for_capacity(1000, 0.01));
+    REQUIRE(ints(core::view(deduplicated).distinct()) == deduplicated);
+    REQUIRE(deduplicated.size() > 950);
+    REQUIRE(deduplicated.size() <= 1000);
+
+    // The keys seen are shared by all the elements, so the parallel terminals do not split the stage.
+    const core::parallel_options options{ 4, 64 };
+    const auto modulo = core::range(0, 200000).transform([](int x) { return x % 10; });
+    REQUIRE(core::view(std::vector<int>(modulo)).distinct().par_to_vector(options) == ints(core::range(0, 10)));
+    REQUIRE(modulo.distinct().par_to_vector(options) == ints(core::range(0, 10)));
+    REQUIRE(
+        modulo.distinct(core::bloom_filter<int>::for_capacity(100, 0.01)).par_accumulate(0, std::plus<>{}, options) <= 45);
+}
+
+TEST_CASE("sequence - sampling", "[sequence]")
+{
+    using ints = std::vector<int>;
+
+    const ints sampled = core::range(0, 100000).sample_bernoulli(0.1, 42);
+    REQUIRE(sampled.size() > 9000);
+    REQUIRE(sampled.size() < 11000);
+    REQUIRE(std::adjacent_find(sampled.begin(), sampled.end(), std::greater_equal<>{}) == sampled.end());
+    REQUIRE(ints(core::range(0, 100).sample_bernoulli(0.0, 1)).empty());
+    REQUIRE(ints(core::range(0, 100).sample_bernoulli(1.0, 1)) == ints(core::range(0, 100)));
+    REQUIRE_THROWS_AS(core::range(0, 100).sample_bernoulli(1.5, 1), std::invalid_argument);
+
+    ints all = core::range(0, 10).reservoir(20, 7);
+    std::sort(all.begin(), all.end());
+    REQUIRE(all == ints(core::range(0, 10)));
+
+    int first_hits = 0;
+    int last_hits = 0;
+    for (std::uint64_t seed = 0; seed < 2000; ++seed)
+    {
+        ints sample = core::range(0, 100).reservoir(10, seed);
+        std::sort(sample.begin(), sample.end());
+        REQUIRE(sample.size() == 10);
+        REQUIRE(std::adjacent_find(sample.begin(), sample.end()) == sample.end());
+        first_hits += sample.front() == 0 ? 1 : 0;
+        last_hits += sample.back() == 99 ? 1 : 0;
+    }
+    REQUIRE(first_hits > 120);
+    REQUIRE(first_hits < 280);
+    REQUIRE(last_hits > 120);
+    REQUIRE(last_hits < 280);
+
+    std::vector<int> hits(10, 0);
+    for (std::uint64_t seed = 0; seed < 4000; ++seed)
+    {
+        const ints sample = core::range(0, 10).weighted_reservoir(1, [](int x) { return x; }, seed);
+        REQUIRE(sample.size() == 1);
+        ++hits[sample[0]];
+    }
+    REQUIRE(hits[0] == 0);
+    REQUIRE(hits[9] > 650);
+    REQUIRE(hits[9] < 950);
+    REQUIRE(hits[1] < hits[5]);
+}
+
+TEST_CASE("sequence - split_fields", "[sequence]")
+{
+    using strings = std::vector<std::string>;
+    const auto split = [](const std::string& line, char delim = ',')
+    {
+        strings result;
+        core::single(line).split_fields(delim).for_each(
+            [&](core::span<std::string_view> fields) { result.assign(fields.begin(), fields.end()); });
+        return result;
+    };
+
+    REQUIRE(split("") == strings{ "" });
+    REQUIRE(split("a,bb,,ccc,") == strings{ "a", "bb", "", "ccc", "" });
+    REQUIRE(split("a field longer than a word,x") == strings{ "a field longer than a word", "x" });
+    REQUIRE(split("a;b,c", ';') == strings{ "a", "b,c" });
+    REQUIRE(split(R"("a,b","",x"y)") == strings{ "a,b", "", "x\"y" });
+    REQUIRE(split(R"("say ""hi""","""",end)") == strings{ "say \"hi\"", "\"", "end" });
+    REQUIRE_THROWS_AS(split(R"("open,end)"), std::runtime_error);
+    REQUIRE_THROWS_AS(split(R"("a"b,c)"), std::runtime_error);
+
+    const std::vector<std::string> lines = { "1,2.5,one", "-3,1e3,\"t,w,o\"" };
+    REQUIRE(
+        std::vector<std::tuple<int, double, std::string>>(core::view(lines).parse_fields<int, double, std::string>())
+        == std::vector<std::tuple<int, double, std::string>>{ { 1, 2.5, "one" }, { -3, 1000.0, "t,w,o" } });
+    using pairs = std::vector<std::tuple<int, int>>;
+    REQUIRE_THROWS_AS(pairs(core::view(lines).parse_fields<int, int>()), std::invalid_argument);
+
+    REQUIRE(core::parse_field<core::maybe<int>>("") == core::none);
+    REQUIRE(core::parse_field<core::maybe<int>>("42") == 42);
+    REQUIRE_THROWS_AS(core::parse_field<int>("42x"), std::invalid_argument);
+}
+
+TEST_CASE("sequence - push mode", "[sequence]")
+{
+    int pulled = 0;
+    REQUIRE(
+        std::vector<int>(core::iota(0).inspect([&](int) { ++pulled; }).filter([](int x) { return x % 2 == 0; }).take(4))
+        == std::vector<int>{ 0, 2, 4, 6 });
+    REQUIRE(pulled == 7);
+
+    const std::vector<int> first = { 1, 2, 3 };
+    const std::vector<int> second = { 4, 5, 6 };
+    REQUIRE(std::vector<int>(core::concat(core::view(first), core::view(second)).take(4)) == std::vector<int>{ 1, 2, 3, 4 });
+    REQUIRE(
+        std::vector<int>(core::concat(core::view(first), core::view(second)).drop(2).transform([](int x) { return x * 10; }))
+        == std::vector<int>{ 30, 40, 50, 60 });
+    REQUIRE(std::vector<int>(core::view(second).transform([](int x) { return -x; }).take(2)) == std::vector<int>{ -4, -5 });
+    REQUIRE(std::vector<int>(core::sequence<int>{}.take(3)).empty());
+    REQUIRE(std::vector<int>(core::range(0, 10).take(0)).empty());
+}
+
+TEST_CASE("sequence - tee", "[sequence]")
+{
+    int pulled = 0;
+    const auto source = core::range(0, 5000).inspect([&](int) { ++pulled; });
+
+    std::vector<core::sequence<int>> outputs = source.tee(3);
+    REQUIRE(outputs.size() == 3);
+    REQUIRE(outputs[1].size_hint().lower == 5000);
+    const std::vector<int> first = std::move(outputs[0]);
+    const long long sum = std::move(outputs[1]).accumulate(0LL, std::plus<>{});
+    const std::vector<int> last = std::move(outputs[2]).take(3);
+    REQUIRE(first == std::vector<int>(core::range(0, 5000)));
+    REQUIRE(sum == 12497500);
+    REQUIRE(last == std::vector<int>{ 0, 1, 2 });
+    REQUIRE(pulled == 5000);
+
+    // Outputs consumed in step only buffer a few elements.
+    pulled = 0;
+    std::vector<core::sequence<int>> pair = source.tee(2, 4);
+    const core::next_function_t<int> lhs = std::move(pair[0]).get_next_function();
+    const core::next_function_t<int> rhs = std::move(pair[1]).get_next_function();
+    pair.clear();
+    int expected = 0;
+    while (const auto x = lhs())
+    {
+        REQUIRE(*x == expected);
+        REQUIRE(rhs() == expected);
+        ++expected;
+    }
+    REQUIRE(expected == 5000);
+    REQUIRE(!rhs());
+    REQUIRE(pulled == 5000);
+
+    std::vector<core::sequence<int>> bounded = source.tee(2, 100);
+    REQUIRE_THROWS_AS(std::vector<int>(std::move(bounded[0])), std::length_error);
+
+    // A const& terminal consumes a copy of the output, which leaves the original holding the buffer; moving the
+    // output hands it over.
+    const std::vector<core::sequence<int>> copied = source.tee(1);
+    REQUIRE(std::vector<int>(copied[0]) == std::vector<int>(core::range(0, 5000)));
+    REQUIRE(std::vector<int>(copied[0]) == std::vector<int>(core::range(0, 5000)));
+    const std::vector<core::sequence<int>> held = source.tee(1, 100);
+    REQUIRE_THROWS_AS(std::vector<int>(held[0]), std::length_error);
+    std::vector<core::sequence<int>> handed = source.tee(1, 100);
+    REQUIRE(std::vector<int>(std::move(handed[0])).size() == 5000);
+    std::vector<core::sequence<int>> zipped = source.tee(2, 100);
+    auto both = core::zip(zipped[0], zipped[1]);
+    zipped.clear();
+    REQUIRE(std::vector<std::tuple<int, int>>(std::move(both)).size() == 5000);
+
+    struct counter
+    {
+        int count = 0;
+
+        void operator()(int)
+        {
+            ++count;
+        }
+    };
+    struct histogram
+    {
+        std::vector<int> bins = std::vector<int>(4);
+
+        void operator()(int x)
+        {
+            ++bins[static_cast<std::size_t>(x % 4)];
+        }
+    };
+    pulled = 0;
+    const auto [c, h] = source.fork_to(counter{}, histogram{});
+    REQUIRE(c.count == 5000);
+    REQUIRE(h.bins == std::vector<int>{ 1250, 1250, 1250, 1250 });
+    REQUIRE(pulled == 5000);
+}
+
+TEST_CASE("sequence - hash_join", "[sequence]")
+{
+    using row = std::tuple<int, std::string>;
+    const std::vector<row> names = { { 1, "one" }, { 2, "two" }, { 2, "deux" }, { 4, "four" } };
+    const std::vector<int> events = { 2, 3, 1, 2, 5 };
+    const auto id = [](const row& r) { return std::get<0>(r); };
+    const auto self = [](int x) { return x; };
+
+    using joined = std::vector<std::tuple<row, int>>;
+    REQUIRE(
+        joined(core::hash_join(core::view(names), core::view(events), id, self))
+        == joined{ { { 2, "two" }, 2 }, { { 2, "deux" }, 2 }, { { 1, "one" }, 1 }, { { 2, "two" }, 2 },
+                   { { 2, "deux" }, 2 } });
+
+    REQUIRE(
+        joined(core::hash_join(core::view(names), core::view(events), id, self).take(1)) == joined{ { { 2, "two" }, 2 } });
+    const auto pulled = core::hash_join(core::view(names), core::view(events), id, self);
+    REQUIRE(joined(pulled.begin(), pulled.end()) == joined(pulled));
+
+    using left_joined = std::vector<std::tuple<core::maybe<row>, int>>;
+    const left_joined left = core::left_join(core::view(names), core::view(events), id, self);
+    REQUIRE(left.size() == 7);
+    REQUIRE(!std::get<0>(left[2]));
+    REQUIRE(std::get<1>(left[2]) == 3);
+    REQUIRE(std::get<0>(*std::get<0>(left[3])) == 1);
+    REQUIRE(!std::get<0>(left[6]));
+    REQUIRE(std::get<1>(left[6]) == 5);
+    REQUIRE(joined(core::hash_join(core::sequence<row>{}, core::view(events), id, self)).empty());
+
+    // Partitioning preserves the matches, though not their order.
+    const auto many = core::range(0, 20000).transform([](int x) { return x % 7000; });
+    const auto keys = core::range(0, 10000).transform([](int x) { return row{ x, std::to_string(x) }; });
+    core::join_options options;
+    options.radix_bits = 4;
+    options.probe_block_size = 1000;
+    using pairs = std::vector<std::pair<int, int>>;
+    const auto to_pairs = [](core::sequence<std::tuple<row, int>> s)
+    {
+        pairs result;
+        std::move(s).for_each(
+            [&](const std::tuple<row, int>& t) { result.emplace_back(std::get<0>(std::get<0>(t)), std::get<1>(t)); });
+        std::sort(result.begin(), result.end());
+        return result;
+    };
+    const pairs expected = to_pairs(core::hash_join(keys, many, id, self));
+    REQUIRE(expected.size() == 20000);
+    REQUIRE(to_pairs(core::hash_join(keys, many, id, self, options)) == expected);
+    options.radix_bits = 17;
+    REQUIRE_THROWS_AS(core::hash_join(keys, many, id, self, options), std::invalid_argument);
+
+    // A shorter probe side becomes the table; rows keep the (build, probe) orientation.
+    int build_pulled = 0;
+    const auto counted = keys.inspect([&](const row&) { ++build_pulled; });
+    const std::vector<int> few = { 5, 3 };
+    REQUIRE(joined(core::hash_join(counted, core::view(few), id, self).take(1)) == joined{ { { 3, "3" }, 3 } });
+    REQUIRE(build_pulled < 10000);
+    build_pulled = 0;
+    core::join_options as_given;
+    as_given.build_smaller = false;
+    REQUIRE(joined(core::hash_join(counted, core::view(few), id, self, as_given).take(1)) == joined{ { { 5, "5" }, 5 } });
+    REQUIRE(build_pulled == 10000);
+}
+
+TEST_CASE("sequence - rolling", "[sequence]")
+{
+    std::mt19937 rng{ 7 };
+    std::vector<int> values(1000);
+    std::generate(values.begin(), values.end(), [&] { return static_cast<int>(rng() % 2001) - 1000; });
+
+    for (const std::ptrdiff_t n : { 1, 2, 7, 100, 1000 })
+    {
+        const auto reduce = [&](auto func)
+        {
+            return std::vector<int>(core::view(values).window(n).transform(
+                [&](core::span<int> w) { return std::accumulate(w.begin() + 1, w.end(), *w.begin(), func); }));
+        };
+        REQUIRE(std::vector<int>(core::view(values).rolling_sum(n)) == reduce(std::plus<>{}));
+        REQUIRE(std::vector<int>(core::view(values).rolling_min(n)) == reduce([](int a, int b) { return std::min(a, b); }));
+        REQUIRE(std::vector<int>(core::view(values).rolling_max(n)) == reduce([](int a, int b) { return std::max(a, b); }));
+        REQUIRE(core::view(values).rolling_max(n).size_hint().lower == values.size() - static_cast<std::size_t>(n) + 1);
+    }
+
+    // The aggregates respect the order of the elements.
+    const std::vector<std::string> letters = { "a", "b", "c", "d", "e" };
+    REQUIRE(
+        std::vector<std::string>(core::view(letters).rolling(3, std::string{}, std::plus<>{}))
+        == std::vector<std::string>{ "abc", "bcd", "cde" });
+    REQUIRE(std::vector<int>(core::range(0, 3).rolling_sum(4)).empty());
+    REQUIRE(core::range(0, 3).rolling_sum(4).size_hint().upper == std::size_t{ 0 });
+    REQUIRE_THROWS_AS(core::range(0, 3).rolling_min(0), std::invalid_argument);
+
+    const core::sequence<int> sums = core::range(0, 6).rolling_sum(3);
+    REQUIRE(std::vector<int>(sums.begin(), sums.end()) == std::vector<int>{ 3, 6, 9, 12 });
+    REQUIRE(std::vector<int>(sums.take(2)) == std::vector<int>{ 3, 6 });
+}
@@ -0,0 +1,165 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <ferrugo/core/sequence_io.hpp>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace ferrugo;
+
+namespace
+{
+
+struct temp_file
+{
+    std::string path;
+
+    explicit temp_file(const std::string& content)
+    {
+        static int counter = 0;
+        path = (std::filesystem::temp_directory_path() / ("ferrugo-core-test-" + std::to_string(counter++))).string();
+        std::ofstream(path, std::ios::binary) << content;
+    }
+
+    ~temp_file()
+    {
+        std::remove(path.c_str());
+    }
+};
+
+}  // namespace
+
+TEST_CASE("mmap_lines - same lines as get_lines", "[sequence]")
+{
+    for (const std::string content : { "", "a", "a\n", "a\nbb\r\nccc", "\n\nx\r\ry\r\n", "last\r" })
+    {
+        const temp_file file{ content };
+        std::istringstream is{ content };
+        const std::vector<std::string> expected = core::get_lines(is);
+        const std::vector<std::string> actual = core::mmap_lines(file.path).transform([](std::string_view line)
+                                                                                      { return std::string{ line }; });
+        REQUIRE(actual == expected);
+    }
+}
+
+TEST_CASE("mmap_lines - missing file", "[sequence]")
+{
+    REQUIRE_THROWS_AS(core::mmap_lines("/nonexistent/file.txt"), std::system_error);
+}
+
+namespace
+{
+
+struct record
+{
+    std::int32_t id;
+    double value;
+};
+
+auto record_bytes(int count) -> std::string
+{
+    std::string bytes;
+    for (int i = 0; i < count; ++i)
+    {
+        const record r{ i, i * 0.5 };
+        bytes.append(reinterpret_cast<const char*>(&r), sizeof(r));
+    }
+    return bytes;
+}
+
+}  // namespace
+
+TEST_CASE("read_records - istream and fd", "[sequence]")
+{
+    const temp_file file{ record_bytes(1000) };
+    const auto ids = [](const core::sequence<record>& records)
+    { return std::vector<int>(records.transform([](const record& r) { return r.id; })); };
+    const std::vector<int> expected = core::range(0, 1000);
+
+    for (const bool double_buffered : { false, true })
+    {
+        const core::record_options options{ 100 * sizeof(record) + 5, double_buffered };
+        std::ifstream is{ file.path, std::ios::binary };
+        REQUIRE(ids(core::read_records<record>(is, options)) == expected);
+
+        const int fd = ::open(file.path.c_str(), O_RDONLY);
+        REQUIRE(fd >= 0);
+        REQUIRE(ids(core::read_records<record>(fd, options).drop(990)) == std::vector<int>(core::range(990, 1000)));
+        ::close(fd);
+
+        std::ifstream blocks_is{ file.path, std::ios::binary };
+        const std::vector<std::ptrdiff_t> block_sizes
+            = core::read_record_blocks<record>(blocks_is, options).transform([](core::span<record> b) { return b.size(); });
+        REQUIRE(block_sizes == std::vector<std::ptrdiff_t>(10, 100));
+    }
+
+    std::istringstream empty{ "" };
+    REQUIRE(std::vector<int>(core::read_records<record>(empty).transform([](const record& r) { return r.id; })).empty());
+
+    for (const bool double_buffered : { false, true })
+    {
+        std::istringstream truncated{ record_bytes(10) + "abc" };
+        REQUIRE_THROWS_AS(
+            ids(core::read_records<record>(truncated, core::record_options{ 4096, double_buffered })), std::runtime_error);
+    }
+}
+
+TEST_CASE("read_records - double buffered input is read from the first pull", "[sequence]")
+{
+    const core::record_options options{ 4096, true };
+    std::istringstream is{ record_bytes(10) };
+    {
+        const auto records = core::read_records<record>(is, options);
+        REQUIRE(is.tellg() == 0);
+    }
+    REQUIRE(is.tellg() == 0);
+
+    // A pipe whose writer stays silent: nothing is read, so dropping the sequence does not wait for the writer.
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+    {
+        const auto records = core::read_records<record>(fds[0], options);
+    }
+    const std::string bytes = record_bytes(3);
+    REQUIRE(::write(fds[1], bytes.data(), bytes.size()) == static_cast<::ssize_t>(bytes.size()));
+    ::close(fds[1]);
+    REQUIRE(std::vector<int>(core::read_records<record>(fds[0], options).transform([](const record& r) { return r.id; }))
+            == std::vector<int>{ 0, 1, 2 });
+    ::close(fds[0]);
+}
+
+TEST_CASE("csv_records - quoted fields may span lines", "[sequence]")
+{
+    std::istringstream is{ "id,text\r\n1,\"multi\nline\"\n2,\"a \"\"quote\"\"\"\n3,plain" };
+    std::vector<std::vector<std::string>> records;
+    core::csv_records(is).for_each([&](core::span<std::string_view> fields)
+                                   { records.emplace_back(fields.begin(), fields.end()); });
+    REQUIRE(
+        records
+        == std::vector<std::vector<std::string>>{
+            { "id", "text" }, { "1", "multi\nline" }, { "2", "a \"quote\"" }, { "3", "plain" } });
+
+    // Line breaks inside quotes are kept as they are.
+    std::istringstream crlf{ "1,\"a\r\nb\"\r\n2,\"c\rd\",x\"y\r\n\r\n3,\"\"" };
+    records.clear();
+    core::csv_records(crlf).for_each([&](core::span<std::string_view> fields)
+                                     { records.emplace_back(fields.begin(), fields.end()); });
+    REQUIRE(
+        records
+        == std::vector<std::vector<std::string>>{
+            { "1", "a\r\nb" }, { "2", "c\rd", "x\"y" }, { "" }, { "3", "" } });
+
+    std::istringstream typed{ "1;0.5\n2;1.5\n" };
+    REQUIRE(
+        std::vector<std::tuple<int, double>>(core::csv_records(typed, ';').transform(core::parse_row<int, double>))
+        == std::vector<std::tuple<int, double>>{ { 1, 0.5 }, { 2, 1.5 } });
+
+    std::istringstream unterminated{ "1,\"abc\n2,3" };
+    REQUIRE_THROWS_AS(core::csv_records(unterminated).for_each([](auto&&) {}), std::runtime_error);
+}
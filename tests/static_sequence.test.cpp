@@ -0,0 +1,140 @@
+#include <catch2/catch_test_macros.hpp>
+#include <ferrugo/core/static_sequence.hpp>
+#include <iterator>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace ferrugo;
+
+TEST_CASE("static_sequence - adaptors", "[sequence]")
+{
+    const std::vector<int> result = core::static_range(0, 20)
+                                        .transform([](int x) { return x * 3; })
+                                        .filter([](int x) { return x % 2 == 0; })
+                                        .drop(1)
+                                        .take(4);
+    REQUIRE(result == std::vector<int>{ 6, 12, 18, 24 });
+}
+
+TEST_CASE("static_sequence - take and drop", "[sequence]")
+{
+    using ints = std::vector<int>;
+    REQUIRE(ints(core::static_range(0, 5).take(0)).empty());
+    REQUIRE(ints(core::static_range(0, 5).take(10)) == ints{ 0, 1, 2, 3, 4 });
+    REQUIRE(ints(core::static_iota(0).take(3)) == ints{ 0, 1, 2 });
+    REQUIRE(ints(core::static_range(0, 5).drop(0)) == ints{ 0, 1, 2, 3, 4 });
+    REQUIRE(ints(core::static_range(0, 5).drop(10)).empty());
+    REQUIRE(ints(core::static_range(0, 5).drop(-2)) == ints{ 0, 1, 2, 3, 4 });
+    REQUIRE(ints(core::static_iota(0).drop(5).take(2)) == ints{ 5, 6 });
+}
+
+TEST_CASE("static_sequence - take of a negative count", "[sequence]")
+{
+    REQUIRE(std::vector<int>(core::static_range(0, 5).take(-1)).empty());
+    REQUIRE(core::static_iota(0).take(-3).accumulate(0, std::plus<>{}) == 0);
+}
+
+TEST_CASE("static_sequence - reusable", "[sequence]")
+{
+    const auto seq = core::static_iota(1).take_while([](int x) { return x <= 5; });
+    REQUIRE(seq.accumulate(0, std::plus<>{}) == 15);
+    REQUIRE(seq.accumulate(0, std::plus<>{}) == 15);
+    REQUIRE(seq.maybe_front() == 1);
+    REQUIRE(seq.find_if([](int x) { return x > 3; }) == 4);
+}
+
+TEST_CASE("static_sequence - conversion to sequence", "[sequence]")
+{
+    const std::vector<std::string> v = { "a", "bb", "ccc" };
+    const core::sequence<std::size_t> seq = core::static_view(v).transform([](const std::string& s) { return s.size(); });
+    REQUIRE(std::vector<std::size_t>(seq) == std::vector<std::size_t>{ 1, 2, 3 });
+}
+
+TEST_CASE("static_sequence - step", "[sequence]")
+{
+    using ints = std::vector<int>;
+    REQUIRE(ints(core::static_range(0, 10).step(3)) == ints{ 0, 3, 6, 9 });
+    REQUIRE(ints(core::static_range(0, 3).step(1)) == ints{ 0, 1, 2 });
+    REQUIRE(ints(core::static_range(0, 3).step(5)) == ints{ 0 });
+    REQUIRE(ints(core::static_iota(1).step(2).take(3)) == ints{ 1, 3, 5 });
+}
+
+TEST_CASE("static_sequence - take_while and drop_while", "[sequence]")
+{
+    using ints = std::vector<int>;
+    const auto small = [](int x) { return x < 3; };
+    REQUIRE(ints(core::static_range(0, 6).take_while(small)) == ints{ 0, 1, 2 });
+    REQUIRE(ints(core::static_range(0, 6).drop_while(small)) == ints{ 3, 4, 5 });
+    REQUIRE(ints(core::static_range(0, 3).drop_while(small)).empty());
+    REQUIRE(ints(core::static_range(5, 8).drop_while(small)) == ints{ 5, 6, 7 });
+
+    // Only the leading elements are dropped.
+    const ints v = { 1, 5, 2, 6 };
+    REQUIRE(ints(core::static_view(v).drop_while(small)) == ints{ 5, 2, 6 });
+}
+
+TEST_CASE("static_sequence - indexed adaptors", "[sequence]")
+{
+    using ints = std::vector<int>;
+    const ints v = { 10, 20, 30, 40 };
+    REQUIRE(
+        ints(core::static_view(v).transform_indexed([](std::ptrdiff_t i, int x) { return static_cast<int>(i) + x; }))
+        == ints{ 10, 21, 32, 43 });
+    REQUIRE(ints(core::static_view(v).filter_indexed([](std::ptrdiff_t i, int) { return i % 2 == 1; })) == ints{ 20, 40 });
+
+    // A copy of the sequence starts over from index 0.
+    const auto odd = core::static_view(v).filter_indexed([](std::ptrdiff_t i, int) { return i % 2 == 1; });
+    REQUIRE(ints(odd) == ints(odd));
+}
+
+TEST_CASE("static_sequence - transform_maybe", "[sequence]")
+{
+    const std::vector<std::string> v = { "1", "x", "22", "", "333" };
+    using sizes = std::vector<std::size_t>;
+    const auto lengths = core::static_view(v).transform_maybe(
+        [](const std::string& s) -> core::maybe<std::size_t>
+        {
+            if (s.empty() || s == "x")
+            {
+                return {};
+            }
+            return s.size();
+        });
+    REQUIRE(sizes(lengths) == sizes{ 1, 2, 3 });
+    REQUIRE(sizes(core::static_range(0, 5).transform_maybe([](int) { return core::maybe<std::size_t>{}; })).empty());
+}
+
+TEST_CASE("static_sequence - inspect and copy", "[sequence]")
+{
+    std::vector<int> seen;
+    const auto seq = core::static_range(0, 4).inspect([&](int x) { seen.push_back(x); });
+    REQUIRE(seen.empty());
+
+    std::vector<int> copied;
+    seq.copy(std::back_inserter(copied));
+    REQUIRE(copied == std::vector<int>{ 0, 1, 2, 3 });
+    REQUIRE(seen == copied);
+
+    // maybe_front pulls a single element.
+    seen.clear();
+    REQUIRE(seq.maybe_front() == 0);
+    REQUIRE(seen == std::vector<int>{ 0 });
+}
+
+TEST_CASE("static_sequence - static_unfold", "[sequence]")
+{
+    const auto powers = core::static_unfold(
+        1,
+        [](int state) -> core::maybe<std::tuple<int, int>>
+        {
+            if (state > 100)
+            {
+                return {};
+            }
+            return std::tuple<int, int>{ state, state * 2 };
+        });
+    REQUIRE(std::vector<int>(powers) == std::vector<int>{ 1, 2, 4, 8, 16, 32, 64 });
+    REQUIRE(std::vector<int>(powers.take(3)) == std::vector<int>{ 1, 2, 4 });
+    REQUIRE(powers.accumulate(0, std::plus<>{}) == 127);
+}